@@ -0,0 +1,361 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../include/buffers.hpp"
+#include "../include/constants.hpp"
+#include "../include/functions.hpp"
+#include "../include/kernels.hpp"
+
+// Benchmarks for dynoXOR, written as JSON so runs can be compared:
+//   bench_dynoXOR [--quick] [--dir DIR] [--out FILE] [--baseline FILE]
+//   bench_dynoXOR --compare BASELINE CURRENT [--threshold PERCENT]
+
+namespace {
+
+struct Result {
+  std::string name;
+  uint64_t iterations;
+  double nsPerOp;
+  // Bytes processed per operation (0 when throughput does not apply)
+  uint64_t bytes;
+};
+
+// Drops everything written to it, without storing or allocating
+class NullBuffer : public std::streambuf {
+ protected:
+  int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+
+  std::streamsize xsputn(const char*, std::streamsize count) override {
+    return count;
+  }
+};
+
+// Sends std::cout to a NullBuffer while in scope, and back to the console
+// on every exit, including an exception
+class DiscardConsole {
+ public:
+  DiscardConsole() : console_(std::cout.rdbuf(&discarded_)) {}
+  DiscardConsole(const DiscardConsole&) = delete;
+  DiscardConsole& operator=(const DiscardConsole&) = delete;
+  ~DiscardConsole() { std::cout.rdbuf(console_); }
+
+ private:
+  NullBuffer discarded_;
+  std::streambuf* console_;
+};
+
+struct Settings {
+  bool quick{false};
+  // Directory for the on-disk end-to-end benchmarks
+  std::string dir{"."};
+  std::string out;
+  std::string baseline;
+  std::string compare[2];
+  double threshold{10.0};
+};
+
+// Run fn repeatedly for at least minTime and return the average
+template <typename Fn>
+Result measure(const std::string& name, uint64_t bytes,
+               std::chrono::duration<double> minTime, Fn&& fn) {
+  using Clock = std::chrono::steady_clock;
+
+  // One untimed call warms caches and lazily initialized state
+  fn();
+
+  uint64_t iterations{0};
+  const Clock::time_point start{Clock::now()};
+  Clock::time_point now{start};
+
+  while (now - start < minTime) {
+    fn();
+    ++iterations;
+    now = Clock::now();
+  }
+
+  const double ns{
+      std::chrono::duration<double, std::nano>(now - start).count()};
+  std::cerr << "  " << name << '\n';
+
+  return {name, iterations, ns / static_cast<double>(iterations), bytes};
+}
+
+std::string sizeName(uint64_t bytes) {
+  if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+    return std::to_string(bytes / (1024 * 1024)) + "MiB";
+  }
+
+  if (bytes >= 1024 && bytes % 1024 == 0) {
+    return std::to_string(bytes / 1024) + "KiB";
+  }
+
+  return std::to_string(bytes) + "B";
+}
+
+// XOR kernels across key lengths, buffer alignments and buffer sizes
+void benchKernels(const Settings& settings, std::vector<Result>& results) {
+  const std::chrono::duration<double> minTime{settings.quick ? 0.01 : 0.05};
+  const std::vector<uint64_t> sizes{4 * 1024, 64 * 1024, 1024 * 1024};
+  IoBuffer buffer{acquireBuffer(sizes.back() + 64)};
+
+  for (uint64_t i{0}; i < buffer.size(); ++i) {
+    buffer.data()[i] = static_cast<char>(i * 31);
+  }
+
+  for (const std::string& kernel : availableXorKernels()) {
+    selectXorKernel(kernel);
+
+    // 16/32/64 take the specialized kernels, the others the expanded key
+    for (size_t keyLen : {16, 18, 32, 64, 100, 4096}) {
+      const std::string key(keyLen, 'k');
+
+      for (size_t align : {0, 1}) {
+        for (uint64_t size : sizes) {
+          const std::string name{"xor/" + kernel + "/key" +
+                                 std::to_string(keyLen) + "/align" +
+                                 std::to_string(align) + "/" + sizeName(size)};
+
+          results.push_back(measure(name, size, minTime, [&] {
+            xorBuffer(buffer.data() + align, size, key, 0);
+          }));
+        }
+      }
+    }
+  }
+
+  selectXorKernel("auto");
+}
+
+void writeFile(const std::string& path, uint64_t size) {
+  std::ofstream file(path, std::ios::binary);
+  std::string block(1024 * 1024, '\0');
+
+  for (size_t i{0}; i < block.size(); ++i) {
+    block[i] = static_cast<char>(i * 131 + 7);
+  }
+
+  for (uint64_t written{0}; written < size; written += block.size()) {
+    file.write(block.data(), static_cast<std::streamsize>(
+                                 std::min<uint64_t>(block.size(),
+                                                    size - written)));
+  }
+}
+
+// processFileInChunks and backupFile on one filesystem
+void benchFiles(const Settings& settings, const std::string& label,
+                const std::filesystem::path& dir,
+                std::vector<Result>& results) {
+  const std::chrono::duration<double> minTime{settings.quick ? 0.2 : 1.0};
+  const uint64_t size{(settings.quick ? 16u : 64u) * 1024 * 1024};
+  const std::string input{(dir / "bench_dynoXOR_input.bin").string()};
+  const std::string output{(dir / "bench_dynoXOR_output.bin").string()};
+  const std::string key(Constants::generatedKeySize, 'k');
+
+  writeFile(input, size);
+
+  results.push_back(measure("file/" + label + "/processFileInChunks/" +
+                                sizeName(size),
+                            size, minTime,
+                            [&] { processFileInChunks(input, output, key); }));
+
+  results.push_back(measure("file/" + label + "/backupFile/" + sizeName(size),
+                            size, minTime, [&] {
+                              backupFile(input);
+                              std::filesystem::remove(input + ".bak");
+                            }));
+
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+void benchGenerateKey(const Settings& settings, std::vector<Result>& results) {
+  const std::chrono::duration<double> minTime{settings.quick ? 0.05 : 0.2};
+  std::string key;
+
+  results.push_back(
+      measure("generateKey", 0, minTime, [&] { generateKey(key); }));
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results) {
+  out << "{\n  \"benchmarks\": [\n";
+
+  for (size_t i{0}; i < results.size(); ++i) {
+    const Result& result{results[i]};
+    const double bytesPerSecond{
+        result.bytes ? static_cast<double>(result.bytes) * 1e9 / result.nsPerOp
+                     : 0};
+
+    // One benchmark per line keeps the files diffable and easy to parse
+    out << "    {\"name\": \"" << result.name
+        << "\", \"iterations\": " << result.iterations
+        << ", \"ns_per_op\": " << std::fixed << std::setprecision(1)
+        << result.nsPerOp << ", \"bytes_per_second\": " << std::setprecision(0)
+        << bytesPerSecond << '}' << (i + 1 < results.size() ? "," : "")
+        << '\n';
+  }
+
+  out << "  ]\n}\n";
+}
+
+// Read name -> ns_per_op from a file written by writeJson
+std::map<std::string, double> readJson(const std::string& path) {
+  std::ifstream file(path);
+
+  if (!file) {
+    throw std::runtime_error("Unable to open benchmark results: " + path);
+  }
+
+  std::map<std::string, double> results;
+  std::string line;
+  const std::string nameField{"\"name\": \""};
+  const std::string nsField{"\"ns_per_op\": "};
+
+  while (std::getline(file, line)) {
+    const size_t name{line.find(nameField)};
+    const size_t ns{line.find(nsField)};
+
+    if (name == std::string::npos || ns == std::string::npos) {
+      continue;
+    }
+
+    const size_t nameStart{name + nameField.size()};
+    results[line.substr(nameStart, line.find('"', nameStart) - nameStart)] =
+        std::stod(line.substr(ns + nsField.size()));
+  }
+
+  return results;
+}
+
+// Print the change of every benchmark; true if any slowed past threshold
+bool compareResults(const std::map<std::string, double>& baseline,
+                    const std::map<std::string, double>& current,
+                    double threshold) {
+  bool regressed{false};
+
+  for (const auto& [name, ns] : current) {
+    auto base{baseline.find(name)};
+
+    if (base == baseline.end()) {
+      std::cout << "  new        " << name << '\n';
+      continue;
+    }
+
+    const double change{(ns - base->second) / base->second * 100};
+    const bool slower{change > threshold};
+    regressed = regressed || slower;
+
+    std::cout << (slower ? "  REGRESSED  " : "  ok         ") << std::showpos
+              << std::fixed << std::setprecision(1) << std::setw(7) << change
+              << std::noshowpos << "%  " << name << '\n';
+  }
+
+  for (const auto& [name, ns] : baseline) {
+    if (!current.count(name)) {
+      std::cout << "  missing    " << name << '\n';
+    }
+  }
+
+  return regressed;
+}
+
+Settings parseArguments(int argc, char* argv[]) {
+  Settings settings;
+
+  for (int i{1}; i < argc; ++i) {
+    const std::string arg{argv[i]};
+    auto value{[&]() -> std::string {
+      if (i + 1 >= argc) {
+        throw std::runtime_error("Missing value for " + arg);
+      }
+
+      return argv[++i];
+    }};
+
+    if (arg == "--quick") {
+      settings.quick = true;
+    } else if (arg == "--dir") {
+      settings.dir = value();
+    } else if (arg == "--out") {
+      settings.out = value();
+    } else if (arg == "--baseline") {
+      settings.baseline = value();
+    } else if (arg == "--compare") {
+      settings.compare[0] = value();
+      settings.compare[1] = value();
+    } else if (arg == "--threshold") {
+      settings.threshold = std::stod(value());
+    } else {
+      throw std::runtime_error("Unknown argument: " + arg);
+    }
+  }
+
+  return settings;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    const Settings settings{parseArguments(argc, argv)};
+
+    if (!settings.compare[0].empty()) {
+      return compareResults(readJson(settings.compare[0]),
+                            readJson(settings.compare[1]), settings.threshold)
+                 ? 1
+                 : 0;
+    }
+
+    std::vector<Result> results;
+
+    {
+      // Library functions report progress on std::cout; keep it for the
+      // JSON, and keep the messages out of the timings
+      DiscardConsole discarded;
+
+      std::cerr << "XOR kernels:\n";
+      benchKernels(settings, results);
+
+      std::cerr << "End to end:\n";
+      benchGenerateKey(settings, results);
+
+      if (std::filesystem::is_directory("/dev/shm")) {
+        benchFiles(settings, "tmpfs", "/dev/shm", results);
+      }
+
+      benchFiles(settings, "disk", settings.dir, results);
+    }
+
+    if (settings.out.empty()) {
+      writeJson(std::cout, results);
+    } else {
+      std::ofstream out(settings.out);
+      writeJson(out, results);
+    }
+
+    if (!settings.baseline.empty()) {
+      std::map<std::string, double> current;
+
+      for (const Result& result : results) {
+        current[result.name] = result.nsPerOp;
+      }
+
+      return compareResults(readJson(settings.baseline), current,
+                            settings.threshold)
+                 ? 1
+                 : 0;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << '\n';
+    return 2;
+  }
+
+  return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef BACKENDS_HPP
+#define BACKENDS_HPP
+
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+
+/*
+@brief Parse an I/O backend name as accepted by --io-backend.
+@param name One of "stream", "posix" or "uring".
+@throws std::runtime_error if the name is unknown.
+*/
+IoBackend parseIoBackend(const std::string& name);
+
+/*
+@brief Get the name of an I/O backend.
+*/
+std::string ioBackendName(IoBackend backend);
+
+/*
+@brief Check whether the running kernel accepts io_uring rings and implements
+the read and write opcodes used by processFileUring (Linux 5.6 and later).
+@return false when dynoXOR was built without io_uring or the kernel refuses it.
+*/
+bool uringSupported();
+
+/*
+@brief Sequential read/XOR/write loop using blocking POSIX read and write calls.
+@throws std::runtime_error on IO errors or if POSIX I/O is unavailable.
+*/
+void processFilePosix(const std::string& filename, const std::string& outfile,
+                      std::string_view xorkey, const ProcessOptions& options);
+
+/*
+@brief Read/XOR/write loop keeping several io_uring reads and writes in flight.
+Uses options.queueDepth registered buffers of options.chunkSize bytes each.
+@throws std::runtime_error on IO errors or if the ring cannot be set up.
+*/
+void processFileUring(const std::string& filename, const std::string& outfile,
+                      std::string_view xorkey, const ProcessOptions& options);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "functions.hpp"
+
+/*
+@brief One file of a batch run: where to read it and where to write it.
+*/
+struct BatchJob {
+  std::string input;
+  std::string output;
+  uint64_t size;
+  // Set when the job must not run; reported as its failure
+  std::string error{};
+};
+
+/*
+@brief A file of a batch run that could not be processed.
+*/
+struct BatchFailure {
+  std::string input;
+  std::string error;
+};
+
+/*
+@brief Settings applied to every file of a batch run.
+*/
+struct BatchOptions {
+  // Files processed concurrently
+  unsigned jobs{1};
+  // Back up each input before modifying it
+  bool backup{false};
+  // Log the key for each processed file
+  bool keyLog{false};
+  // Pick the chunk size of each file with autoChunkSize
+  bool autoChunkSize{false};
+};
+
+/*
+@brief Read a list of input paths, one per line (blank lines are skipped).
+@param listPath Path to the list file.
+@throws std::runtime_error if the list cannot be read.
+*/
+std::vector<std::string> readFileList(const std::string& listPath);
+
+/*
+@brief Expand input paths into batch jobs, ordered largest file first.
+Directories are walked recursively and contribute their non-empty regular
+files. With an output directory, each file is written there under its name
+(or its path relative to the directory argument); otherwise it is overwritten.
+Paths that do not exist are kept as jobs so they are reported as failures, as
+are jobs sharing an input or output file, including through symlinks or hard
+links. Walks skip this tool's own backups, temporary files and journals
+(<file>.bak, <file>.tmp, <file>.journal while <file> exists, and --calibrate
+samples) and directories they may not read. Entries that vanish or cannot be
+inspected during the walk, and walks that fail, are kept as failed jobs so the
+rest of the batch still runs.
+@param paths Files and directories to process.
+@param outputDir Output directory, or empty to overwrite inputs.
+*/
+std::vector<BatchJob> collectBatchJobs(const std::vector<std::string>& paths,
+                                       const std::string& outputDir);
+
+/*
+@brief Process batch jobs on a pool of worker threads.
+Workers take jobs in list order, so with a largest-first list the longest
+files start early and the pool finishes at nearly the same time. A failing file
+does not stop the batch.
+@param jobs Jobs to run (see collectBatchJobs).
+@param xorkey XOR key string.
+@param options Processing options used for every file.
+@param batch Pool size, backup and logging settings.
+@return The files that failed, with their error messages.
+*/
+std::vector<BatchFailure> runBatch(const std::vector<BatchJob>& jobs,
+                                   std::string_view xorkey,
+                                   const ProcessOptions& options,
+                                   const BatchOptions& batch);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef BUFFERS_HPP
+#define BUFFERS_HPP
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+/*
+@brief How the buffer pool backs newly allocated I/O buffers.
+*/
+enum class HugePages {
+  // Regular pages
+  Off,
+  // Transparent huge pages requested through madvise (Linux)
+  Transparent,
+  // Explicit pages from the hugetlb pool (Linux), regular pages if it is empty
+  Explicit,
+};
+
+/*
+@brief An uninitialized, page-aligned I/O buffer leased from the process-wide
+pool. The memory returns to the pool when the lease is destroyed, so later
+chunks and files reuse it instead of allocating and zero-filling new buffers.
+*/
+class IoBuffer {
+ public:
+  // Memory owned by the pool; alignment 0 marks a mapping of huge pages
+  struct Block {
+    char* data{nullptr};
+    size_t capacity{0};
+    size_t alignment{0};
+  };
+
+  IoBuffer() = default;
+  IoBuffer(Block block, size_t size) : block_(block), size_(size) {}
+  IoBuffer(IoBuffer&& other) noexcept;
+  IoBuffer& operator=(IoBuffer&& other) noexcept;
+  IoBuffer(const IoBuffer&) = delete;
+  IoBuffer& operator=(const IoBuffer&) = delete;
+  ~IoBuffer();
+
+  char* data() const { return block_.data; }
+  size_t size() const { return size_; }
+  std::span<char> span() const { return {block_.data, size_}; }
+
+ private:
+  Block block_;
+  size_t size_{0};
+};
+
+/*
+@brief Lease a buffer of at least size bytes from the pool.
+Buffers are aligned to the page size (at least 4 KiB), which also satisfies
+vector loads and O_DIRECT transfers. Their contents are unspecified.
+@param size Requested size in bytes (0 is treated as 1).
+@throws std::bad_alloc if no memory is available.
+*/
+IoBuffer acquireBuffer(size_t size);
+
+/*
+@brief Parse a huge page mode as accepted by --huge-pages.
+@param name One of "off", "transparent" or "explicit".
+@throws std::runtime_error if the name is unknown.
+*/
+HugePages parseHugePages(const std::string& name);
+
+/*
+@brief Choose how buffers allocated from now on are backed.
+Buffers already in the pool keep their pages.
+*/
+void setHugePages(HugePages mode);
+
+#endif
@@ -9,23 +9,58 @@ namespace Constants {
 
 inline const std::string& appName{"dynoXOR"};
 inline const std::string& logFileName{"keys.log"};
+// Per-device tuning profiles written by --calibrate
+inline const std::string& profileFileName{"profiles.conf"};
+// Path standing for standard input (-f) or standard output (-o)
+inline const std::string& streamPath{"-"};
 
 // Command-line flags with shortened and long options
 inline const std::string& fileFlag{"-f, --file"};
+inline const std::string& fileListFlag{"-L, --file-list"};
+inline const std::string& jobsFlag{"-J, --jobs"};
 inline const std::string& keyFlag{"-k, --key"};
+inline const std::string& keyFileFlag{"-K, --key-file"};
 inline const std::string& outFlag{"-o, --output"};
 inline const std::string& overwriteFlag{"-O, --overwrite"};
 inline const std::string& backupFlag{"-b, --backup"};
 inline const std::string& generateFlag{"-g, --generate"};
 inline const std::string& logFlag{"-l, --log"};
+inline const std::string& kernelFlag{"--kernel"};
+inline const std::string& printKernelFlag{"--print-kernel"};
+inline const std::string& legacyKeyPhaseFlag{"--legacy-key-phase"};
+inline const std::string& threadsFlag{"-t, --threads"};
+inline const std::string& journalFlag{"-j, --journal"};
+inline const std::string& ioBackendFlag{"--io-backend"};
+inline const std::string& queueDepthFlag{"--queue-depth"};
+inline const std::string& pipelineFlag{"-p, --pipeline"};
+inline const std::string& hugePagesFlag{"--huge-pages"};
+inline const std::string& directFlag{"--direct"};
+inline const std::string& chunkSizeFlag{"--chunk-size"};
+inline const std::string& calibrateFlag{"--calibrate"};
+inline const std::string& noProfileFlag{"--no-profile"};
+inline const std::string& statsFlag{"--stats"};
+inline const std::string& statsJsonFlag{"--stats-json"};
+inline const std::string& perfCountersFlag{"--perf-counters"};
+inline const std::string& offsetFlag{"--offset"};
+inline const std::string& lengthFlag{"--length"};
 
 // Descriptions appearing in CLI help messages
 inline const std::string& fileFlagDescription{
-    "Specify the input file to encrypt or decrypt."};
+    "Specify the input file to encrypt or decrypt ('-' for standard input). "
+    "Repeat it or pass a directory to process many files."};
+inline const std::string& fileListFlagDescription{
+    "Read input paths from a file, one per line."};
+inline const std::string& jobsFlagDescription{
+    "Number of files processed concurrently in batch mode."};
 inline const std::string& keyFlagDescription{
     "Provide the XOR key for encryption/decryption."};
+inline const std::string& keyFileFlagDescription{
+    "Use the bytes of a file as the XOR key, instead of --key. The file is "
+    "memory-mapped and may be as large as the data (one-time pad); a shorter "
+    "one repeats, with a warning."};
 inline const std::string& outFlagDescription{
-    "Specify the output file for the result."};
+    "Specify the output file for the result ('-' for standard output), or "
+    "the output directory in batch mode."};
 inline const std::string& overwriteFlagDescription{
     "Skip confirmation and overwrite the output file if it exists."};
 inline const std::string& backupFlagDescription{
@@ -34,6 +69,52 @@ inline const std::string& generateFlagDescription{
     "Generate a random XOR key instead of supplying a custom key."};
 inline const std::string& logFlagDescription{
     "Log used XOR keys alongside their corresponding filenames for auditing."};
+inline const std::string& kernelFlagDescription{
+    "Force the XOR kernel (auto, scalar, sse2, avx2, avx512)."};
+inline const std::string& printKernelFlagDescription{
+    "Print the XOR kernel selected for this CPU."};
+inline const std::string& legacyKeyPhaseFlagDescription{
+    "Restart the key at each chunk boundary set by --chunk-size (64 KiB by "
+    "default), matching files written by earlier releases."};
+inline const std::string& threadsFlagDescription{
+    "Number of threads XORing the file in parallel (positioned I/O)."};
+inline const std::string& journalFlagDescription{
+    "Keep an undo journal while overwriting in place so an interrupted run "
+    "can be resumed. Without it, an overwrite interrupted midway leaves the "
+    "file partly XORed."};
+inline const std::string& ioBackendFlagDescription{
+    "I/O backend: stream (default), posix, or uring (falls back to posix)."};
+inline const std::string& queueDepthFlagDescription{
+    "Number of reads and writes kept in flight by the uring backend."};
+inline const std::string& pipelineFlagDescription{
+    "Overlap I/O and XOR with a reader, N XOR workers and a writer thread."};
+inline const std::string& hugePagesFlagDescription{
+    "Back I/O buffers with huge pages: off (default), transparent or "
+    "explicit (hugetlb pool, Linux)."};
+inline const std::string& directFlagDescription{
+    "Bypass the page cache with O_DIRECT through the posix or threaded "
+    "engine (drops cached pages instead where O_DIRECT is refused)."};
+inline const std::string& chunkSizeFlagDescription{
+    "Bytes read and written per chunk (K, M or G suffix, default 64K), or "
+    "auto to pick one per file from its storage and a short calibration."};
+inline const std::string& calibrateFlagDescription{
+    "Measure the best chunk size, threads, I/O backend and XOR kernel for "
+    "the device holding the --file and save them as its tuning profile."};
+inline const std::string& noProfileFlagDescription{
+    "Ignore the tuning profile saved by --calibrate for the input's device."};
+inline const std::string& statsFlagDescription{
+    "Print bytes processed, wall time, throughput, time and system calls per "
+    "stage (read, xor, write, fsync, backup, rename) and peak memory."};
+inline const std::string& statsJsonFlagDescription{
+    "Write the --stats report as JSON to the given file."};
+inline const std::string& perfCountersFlagDescription{
+    "Count cycles, instructions, cache and branch misses of the XOR kernel "
+    "with perf_event_open (Linux) and report them per byte."};
+inline const std::string& offsetFlagDescription{
+    "Only XOR the input from this byte offset on, keyed as in the whole file. "
+    "The range is written to --output, or to standard output without it."};
+inline const std::string& lengthFlagDescription{
+    "Number of bytes to XOR from --offset (default: up to the end of file)."};
 
 // Minimum Allowed XOR key size
 inline const int minimumKeySize{16};
@@ -0,0 +1,113 @@
+#ifndef DYNOXOR_HPP
+#define DYNOXOR_HPP
+
+// Public interface of the dynoxor library: in-memory transforms below, and
+// the file-level ones (processFileInChunks, transformFile, backupFile, ...)
+// from functions.hpp. Kernel selection is in kernels.hpp, and the iostream
+// adapter XorStreambuf in xorstreambuf.hpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+#include "kernels.hpp"
+
+/*
+@brief XOR a buffer in place with the repeating key.
+Byte i of data is paired with key[(keyOffset + i) % key.size()], the layout
+of files written by processFileInChunks, so a buffer holding bytes
+[keyOffset, keyOffset + data.size()) of a file gives the same result as
+processing the file. Does not allocate, apart from the per-thread key block
+built on the first call with a short key.
+@param data The bytes to transform.
+@param key XOR key (an empty key leaves the data untouched).
+@param keyOffset Position of data[0] within the stream.
+*/
+void xorBytes(std::span<std::byte> data, std::string_view key,
+              uint64_t keyOffset = 0);
+
+/*
+@brief XOR a buffer into another one, leaving the source untouched.
+Same layout as the in-place overload. The buffers may be the same or overlap.
+@param source The bytes to transform.
+@param destination Receives the result; must have the size of source.
+@param key XOR key (an empty key copies the data).
+@param keyOffset Position of source[0] within the stream.
+@throws std::invalid_argument if the buffer sizes differ.
+*/
+void xorBytes(std::span<const std::byte> source,
+              std::span<std::byte> destination, std::string_view key,
+              uint64_t keyOffset = 0);
+
+/*
+@brief Read and XOR one range of a file, without touching the rest of it.
+The bytes at [offset, offset + destination.size()) are read with a single
+positioned read and keyed on their offset, so a record can be looked up in a
+file of any size (default key layout; transformRange handles the legacy one).
+@param filename Path of the XORed file.
+@param destination Receives the result; its size is the length of the range.
+@param key XOR key.
+@param offset Offset of the first byte of the range.
+@return Bytes read, fewer than destination.size() only at the end of file.
+@throws std::runtime_error if the file cannot be opened or read.
+*/
+size_t readRange(const std::string& filename, std::span<std::byte> destination,
+                 std::string_view key, uint64_t offset);
+
+/*
+@brief Incremental XOR of one stream (a connection, a message sequence).
+Holds the key, its expanded block and the offset reached, so fragments of any
+size fed in order give the same output as one contiguous pass (or as
+processFileInChunks on the whole stream). Copies share the immutable key
+schedule and keep their own offset, so cloning one per connection is cheap.
+A moved-from stream has no key and leaves data untouched.
+*/
+class XorStream {
+ public:
+  /*
+  @param key XOR key (an empty key leaves the data untouched).
+  @param offset Stream position of the first byte that will be fed.
+  */
+  explicit XorStream(std::string_view key, uint64_t offset = 0);
+
+  XorStream(const XorStream&) = default;
+  XorStream& operator=(const XorStream&) = default;
+  XorStream(XorStream&& other) noexcept;
+  XorStream& operator=(XorStream&& other) noexcept;
+  ~XorStream() = default;
+
+  /*
+  @brief XOR the next fragment of the stream in place.
+  */
+  void apply(std::span<std::byte> data);
+  void apply(std::span<char> data);
+
+  /*
+  @brief XOR the next fragment of the stream into another buffer.
+  @throws std::invalid_argument if the buffer sizes differ.
+  */
+  void apply(std::span<const std::byte> source,
+             std::span<std::byte> destination);
+
+  // Stream position of the next byte fed
+  uint64_t offset() const { return offset_; }
+  // Continue from another position (e.g. after a gap or a resend)
+  void seek(uint64_t offset) { offset_ = offset; }
+
+ private:
+  struct Schedule {
+    std::string key;
+    std::string block;
+  };
+
+  // XOR data as the bytes at a stream position, without moving the offset
+  void transform(std::span<char> data, uint64_t offset) const;
+
+  std::shared_ptr<const Schedule> schedule_;
+  uint64_t offset_{0};
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef FILEIO_HPP
+#define FILEIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Positioned POSIX I/O is available on Linux, macOS and the BSDs
+#if defined(__unix__) || defined(__APPLE__)
+#define DYNOXOR_POSIX_IO 1
+#endif
+
+#ifdef DYNOXOR_POSIX_IO
+
+/*
+@brief Owning wrapper around a POSIX file descriptor, closed on destruction.
+*/
+class FileHandle {
+ public:
+  FileHandle() = default;
+  explicit FileHandle(int fd) : fd_(fd) {}
+  FileHandle(FileHandle&& other) noexcept;
+  FileHandle& operator=(FileHandle&& other) noexcept;
+  FileHandle(const FileHandle&) = delete;
+  FileHandle& operator=(const FileHandle&) = delete;
+  ~FileHandle();
+
+  int get() const { return fd_; }
+  explicit operator bool() const { return fd_ >= 0; }
+
+ private:
+  int fd_{-1};
+};
+
+/*
+@brief Open a file for reading.
+@param filename The path to the input file.
+@throws std::runtime_error if the file cannot be opened.
+*/
+FileHandle openInputFile(const std::string& filename);
+
+/*
+@brief Open (creating or truncating) a file for writing.
+@param filename The path to the output file.
+@throws std::runtime_error if the file cannot be opened.
+*/
+FileHandle openOutputFile(const std::string& filename);
+
+/*
+@brief Open an existing file for reading and writing.
+@param filename The path to the file.
+@throws std::runtime_error if the file cannot be opened.
+*/
+FileHandle openReadWriteFile(const std::string& filename);
+
+/*
+@brief Open the fused backup file named in ProcessOptions::backupPath.
+@param backupPath Backup path, or empty when no fused backup is wanted.
+@return An open handle, or an empty one when backupPath is empty.
+@throws std::runtime_error if the backup file cannot be opened.
+*/
+FileHandle openBackupFile(const std::string& backupPath);
+
+/*
+@brief Get the size in bytes of an open file.
+@throws std::runtime_error if the file cannot be inspected.
+*/
+uint64_t fileSize(const FileHandle& file);
+
+/*
+@brief Read up to len bytes at offset, retrying short and interrupted reads.
+@return Number of bytes read, smaller than len only at end of file.
+@throws std::runtime_error on read failure.
+*/
+size_t readAt(const FileHandle& file, char* data, size_t len, uint64_t offset);
+
+/*
+@brief Write exactly len bytes at offset, retrying short and interrupted writes.
+@throws std::runtime_error on write failure.
+*/
+void writeAt(const FileHandle& file, const char* data, size_t len,
+             uint64_t offset);
+
+/*
+@brief Flush a file's data, then the directory entry naming it, to disk.
+@param filename The path to the file.
+@throws std::runtime_error if the file cannot be opened or synced.
+*/
+void syncPath(const std::string& filename);
+
+/*
+@brief Make creations, renames and unlinks inside a file's directory durable.
+Best effort: a directory that cannot be opened or synced is ignored.
+@param filename A path inside the directory.
+*/
+void syncParentDirectory(const std::string& filename);
+
+/*
+@brief Page-cache handling for a file-to-file transfer.
+On construction the output is preallocated to the input size. By default
+the input is advised as sequential, and processed data leaves the cache as
+the run goes, one releaseStride at a time. Input pages are dropped at once.
+Output pages are queued for writeback and dropped at the next release, without
+waiting for the writeback. Input and output may be the same descriptor, for
+files updated in place.
+With --direct, the descriptors use O_DIRECT (F_NOCACHE on macOS) when both
+filesystems accept it. Chunks and transfer lengths are then rounded up to
+directAlignment, and finish() trims the padding of the last write. Where
+O_DIRECT is refused, each stride is written back, waited for and dropped.
+*/
+class PageCachePolicy {
+ public:
+  // Alignment of direct transfers, covering 512-byte and 4 KiB sectors
+  static constexpr size_t directAlignment{4096};
+  // Processed bytes between two releases; output is dropped a stride behind
+  // the write position, once its writeback had time to complete
+  static constexpr uint64_t releaseStride{8 * 1024 * 1024};
+
+  PageCachePolicy(const FileHandle& input, const FileHandle& output,
+                  uint64_t size, bool direct);
+
+  // True when the descriptors really use O_DIRECT
+  bool direct() const { return direct_; }
+
+  // Input size given on construction, the end of a whole-file range
+  uint64_t size() const { return size_; }
+
+  // Chunk size to use, aligned for direct transfers
+  size_t chunkSize(size_t requested) const;
+
+  // Length to read or write for len bytes of data at a chunk boundary
+  size_t transferSize(size_t len) const;
+
+  // Record that [offset, offset + len) of the caller's range [rangeBegin,
+  // rangeEnd) is processed; the cache is released when the chunk completes a
+  // stride or the range. Threads pass their own range, so a release never
+  // reaches into data another thread is working on
+  void release(uint64_t offset, size_t len, uint64_t rangeBegin,
+               uint64_t rangeEnd) const;
+
+  // Trim the output to the bytes actually written
+  void finish(uint64_t size) const;
+
+ private:
+  const FileHandle& input_;
+  const FileHandle& output_;
+  uint64_t size_;
+  bool requestedDirect_;
+  bool direct_{false};
+  bool preallocated_{false};
+};
+
+/*
+@brief Read sequentially from a descriptor until len bytes or end of input.
+Works on pipes and terminals as well as regular files.
+@return Number of bytes read, smaller than len only at end of input.
+@throws std::runtime_error on read failure.
+*/
+size_t readFull(int fd, char* data, size_t len);
+
+/*
+@brief Write exactly len bytes sequentially to a descriptor.
+@throws std::runtime_error on write failure.
+*/
+void writeFull(int fd, const char* data, size_t len);
+
+#endif
+
+#endif
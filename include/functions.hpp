@@ -1,7 +1,10 @@
 #ifndef FUNCTIONS_HPP
 #define FUNCTIONS_HPP
 
+#include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
 #include "constants.hpp"
 
 /*
@@ -16,17 +19,115 @@ Returns the platform-appropriate configuration directory path based on environme
 */
 std::string getConfigDir();
 
+/*
+@brief I/O implementation used by the sequential processing loop.
+*/
+enum class IoBackend {
+  // std::ifstream / std::ofstream (portable default)
+  Stream,
+  // Blocking POSIX read/write on file descriptors
+  Posix,
+  // io_uring with several requests in flight (Linux), falls back to Posix
+  Uring,
+};
+
+/*
+@brief Tuning options for processFileInChunks.
+*/
+struct ProcessOptions {
+  // Size of chunks to process buffer
+  size_t chunkSize{Constants::chunkSize};
+  // Restart the key at every chunk boundary instead of keying on the absolute
+  // file offset (layout written by earlier releases, depends on chunkSize)
+  bool legacyKeyPhase{false};
+  // Number of threads XORing disjoint ranges of the file (1 = sequential)
+  unsigned threads{1};
+  // Keep an undo journal while overwriting a file in place
+  bool journal{false};
+  // I/O implementation for single-threaded runs
+  IoBackend ioBackend{IoBackend::Stream};
+  // Reads and writes kept in flight by the io_uring backend
+  unsigned queueDepth{8};
+  // XOR workers between a reader and a writer thread (0 = no pipeline)
+  unsigned pipelineWorkers{0};
+  // Also write every chunk, as read, to this file (fused backup; empty = off).
+  // Overwrites with a fused backup never run in place
+  std::string backupPath{};
+  // Keep file data out of the page cache (O_DIRECT, else fadvise DONTNEED)
+  bool direct{false};
+};
+
+/*
+@brief XOR a range of a file in place, using the key layout selected in options.
+With the default layout this is xorRange; with legacyKeyPhase the range is split
+at chunk boundaries and the key restarts at each of them.
+@param data The bytes to transform.
+@param xorkey XOR key string.
+@param offset Absolute file offset of data[0].
+@param options Chunk size and key layout.
+*/
+void xorWithLayout(std::span<char> data, std::string_view xorkey,
+                   uint64_t offset, const ProcessOptions& options);
+
 /*
 @brief Process the file in chunks, XORing with key and writing to outfile.
+Each byte is XORed with the key byte at its absolute file offset, so the output
+does not depend on the chunk size. Either path may be "-" to stream from
+standard input or to standard output.
 @param filename Input file path.
 @param outfile Output file path.
 @param xorkey XOR key string.
 @param chunkSize Size of chunks to process buffer (default Constants::chunkSize).
 @throws std::runtime_error on IO errors or file operation failures.*/
 void processFileInChunks(const std::string& filename,
-                         const std::string& outfile, const std::string& xorkey,
+                         const std::string& outfile, std::string_view xorkey,
                          size_t chunkSize = Constants::chunkSize);
 
+/*
+@brief Process the file in chunks using the given options.
+@param filename Input file path.
+@param outfile Output file path.
+@param xorkey XOR key string.
+@param options Chunk size, key layout, threading and I/O backend to use.
+@throws std::runtime_error on IO errors or file operation failures.*/
+void processFileInChunks(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options);
+
+/*
+@brief XOR filename into outfile, choosing the safest engine for the paths.
+When outfile equals filename the file is overwritten: in place through a memory
+mapping where available (journaled with options.journal), otherwise, or when
+the file is not writable, through '<file>.tmp' renamed over the input.
+@param filename Input file path (or "-" for standard input).
+@param outfile Output file path (or "-" for standard output).
+@param xorkey XOR key string.
+@param options Processing options.
+@throws std::runtime_error on IO errors; a failed rename names the temporary
+file left behind.
+*/
+void transformFile(const std::string& filename, const std::string& outfile,
+                   std::string_view xorkey, const ProcessOptions& options);
+
+/*
+@brief XOR only bytes [offset, offset + length) of filename into outfile.
+The input is read from offset on, so the cost depends on length and not on
+the file size. Bytes are keyed on their offset in the file, in the layout
+selected in options, so outfile holds the same bytes as that range of a
+whole-file run. A range reaching past the end of the file is clipped.
+@param filename Input file path (must be seekable, not standard input).
+@param outfile Output file path (or "-" for standard output).
+@param xorkey XOR key string.
+@param offset Offset of the first byte to transform.
+@param length Bytes to transform (UINT64_MAX for up to the end of the file).
+@param options Chunk size and key layout.
+@throws std::runtime_error on IO errors, for standard input, or when outfile
+is the input file.
+*/
+void transformRange(const std::string& filename, const std::string& outfile,
+                    std::string_view xorkey, uint64_t offset,
+                    uint64_t length, const ProcessOptions& options);
+
 /*
 @brief Log the XOR key associated with a filename to a persistent log for auditing or record-keeping.
 @param xorkey The XOR key to log.
@@ -43,6 +144,7 @@ void generateKey(std::string& xorkey);
 
 /*
 @brief Verify that the input file exists and is readable.
+Standard input ("-") is accepted as is, since it can only be checked by reading.
 @param filename The path to the input file.
 @throws std::runtime_error if file does not exist, cannot be opened, or is empty.
 */
@@ -68,11 +170,52 @@ Defaults to overwriting input file if no separate output specified.
 */
 void verifyOutfile(std::string& outfile, std::string& filename, bool overwrite);
 
+/*
+@brief How backupFile copied the data.
+*/
+enum class BackupMethod {
+  // Shared extents via FICLONE (btrfs, XFS): instant, no extra space
+  Reflink,
+  // In-kernel copy via copy_file_range, no userspace round trip
+  CopyFileRange,
+  // Portable stream copy through userspace
+  Stream,
+  // Written by the processing engine from the chunks it reads anyway
+  Fused,
+};
+
+/*
+@brief Get a short name for a backup method ("reflink", "copy_file_range",
+"stream" or "fused").
+*/
+std::string backupMethodName(BackupMethod method);
+
+/*
+@brief Back up the input file as '<file>.bak' and XOR it into outfile.
+A reflink clone is used where the filesystem supports it. Otherwise, when the
+output is another file, the backup is fused with processing: each chunk is
+written to the backup as it is read, so the input is read only once. When the
+input is overwritten, backupFile runs first, and the backup is synced to disk
+before the input is modified.
+@param filename Input file path.
+@param outfile Output file path (may equal filename).
+@param xorkey XOR key string.
+@param options Processing options.
+@return The method that produced the backup.
+@throws std::runtime_error on IO errors.
+*/
+BackupMethod transformFileWithBackup(const std::string& filename,
+                                     const std::string& outfile,
+                                     std::string_view xorkey,
+                                     const ProcessOptions& options);
+
 /*
 @brief Creates a backup of the input file by copying it to a new file with '.bak' appended.
+On Linux a reflink clone is tried first, then copy_file_range, then a stream copy.
 @param filename The path to the original file.
+@return The method that produced the backup.
 @throws std::runtime_error if backup file cannot be created or written.
 */
-void backupFile(const std::string& filename);
+BackupMethod backupFile(const std::string& filename);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef INPLACE_HPP
+#define INPLACE_HPP
+
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+
+/*
+@brief XOR a file in place through a read-write memory mapping.
+The file is mapped one window at a time with sequential access hints and each
+page is XORed directly, so no temporary copy is written. With options.threads
+above one, each window is split across that many threads. When journaling is
+enabled, the original bytes of the window being modified are first saved to
+'<file>.journal'; an interrupted run is resumed from that window the next time
+the file is processed in place with the same key.
+@param filename The file to transform.
+@param xorkey XOR key string.
+@param options Chunk size, key layout, threads and journaling switch.
+@throws std::runtime_error on IO errors, if a leftover journal was written with
+different settings, or if memory mapping is unavailable.
+*/
+void processFileInPlace(const std::string& filename, std::string_view xorkey,
+                        const ProcessOptions& options);
+
+#endif
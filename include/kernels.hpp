@@ -0,0 +1,80 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+@brief Signature shared by every XOR kernel implementation.
+XORs len bytes of data in place with the next len bytes of key stream.
+*/
+using XorKernelFn = void (*)(char* data, const char* key, size_t len);
+
+/*
+@brief XOR a buffer in place with the repeating key using the active kernel.
+Short keys are expanded once per thread into a repeating block, so the kernel
+XORs two contiguous streams without wrapping the key index on every byte.
+Keys of 16, 32 or 64 bytes use kernels specialized for that length, which
+keep the whole key in vector registers.
+Keys of 4096 bytes or more, up to pads as long as the data, are XORed straight
+from their own bytes as a second sequential stream, which the hardware
+prefetchers follow (explicit prefetching measured no faster).
+@param data Pointer to the bytes to transform.
+@param len Number of bytes to transform.
+@param xorkey XOR key string (an empty key leaves the data untouched).
+@param keyIndex Key position paired with the first byte of data.
+*/
+void xorBuffer(char* data, size_t len, std::string_view xorkey,
+               size_t keyIndex = 0);
+
+/*
+@brief Build the repeating key block xorBuffer uses for a key, for callers that
+keep it instead of relying on the per-thread cache (see xorBufferExpanded).
+@return The block, or an empty string for keys that need none (16, 32 and 64
+bytes, and keys of 4096 bytes or more).
+*/
+std::string expandKey(std::string_view xorkey);
+
+/*
+@brief xorBuffer with a key block built by expandKey for the same key.
+@param block Result of expandKey(xorkey).
+*/
+void xorBufferExpanded(char* data, size_t len, std::string_view xorkey,
+                       std::string_view block, size_t keyIndex);
+
+/*
+@brief XOR a range of a stream in place, keyed on its absolute stream offset.
+Byte i of data is paired with xorkey[(keyOffset + i) % keyLen], so splitting a
+stream into ranges of any size, in any order, yields the same output as a
+single pass over the whole stream.
+@param data The bytes to transform.
+@param xorkey XOR key string.
+@param keyOffset Absolute offset of data[0] within the stream.
+*/
+void xorRange(std::span<char> data, std::string_view xorkey,
+              uint64_t keyOffset);
+
+/*
+@brief Get the name of the XOR kernel currently used by xorBuffer.
+@return One of "scalar", "sse2", "avx2" or "avx512".
+*/
+std::string xorKernelName();
+
+/*
+@brief List the XOR kernels supported by the running CPU, slowest first.
+@return Kernel names accepted by selectXorKernel (without "auto").
+*/
+std::vector<std::string> availableXorKernels();
+
+/*
+@brief Override the XOR kernel chosen at startup through CPUID.
+@param name Kernel name, or "auto" to restore the best supported kernel.
+@throws std::runtime_error if the kernel is unknown or unsupported by the CPU.
+*/
+void selectXorKernel(const std::string& name);
+
+#endif
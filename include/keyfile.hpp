@@ -0,0 +1,38 @@
+#ifndef KEYFILE_HPP
+#define KEYFILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+@brief XOR key read from a file (--key-file), kept off the command line.
+The file is memory-mapped read-only where available, so a key may be as large
+as the data (a one-time pad) without being copied into memory up front; pages
+are read ahead as the XOR walks through them in step with the input. Elsewhere
+the file is read into memory.
+*/
+class KeyFile {
+ public:
+  /*
+  @param path Path of the key file.
+  @throws std::runtime_error if the file cannot be opened, mapped or read,
+  or is shorter than Constants::minimumKeySize.
+  */
+  explicit KeyFile(const std::string& path);
+  KeyFile(const KeyFile&) = delete;
+  KeyFile& operator=(const KeyFile&) = delete;
+  ~KeyFile();
+
+  // The whole file as a key; valid for the lifetime of this object
+  std::string_view key() const { return {data_, size_}; }
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+  // Set when data_ is a mapping, otherwise data_ points into contents_
+  bool mapped_{false};
+  std::string contents_;
+};
+
+#endif
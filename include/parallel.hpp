@@ -0,0 +1,22 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+
+/*
+@brief XOR a single file with several threads working on disjoint offset ranges.
+The output is sized up front, then each thread reads, XORs and writes its own
+range with positioned I/O (pread/pwrite).
+@param filename Input file path.
+@param outfile Output file path (must differ from filename).
+@param xorkey XOR key string.
+@param options Chunk size, key layout and number of threads.
+@throws std::runtime_error on IO errors or if positioned I/O is unavailable.
+*/
+void processFileParallel(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+@brief Hardware counters summed over every XOR kernel call (--perf-counters).
+*/
+struct PerfCounts {
+  // False when no counter could be opened; reason then says why
+  bool available{false};
+  std::string reason;
+  uint64_t bytes{0};
+  uint64_t cycles{0};
+  uint64_t instructions{0};
+  uint64_t cacheMisses{0};
+  uint64_t branchMisses{0};
+  // Counters the CPU or hypervisor does not provide stay at 0
+  bool hasCycles{false};
+  bool hasInstructions{false};
+  bool hasCacheMisses{false};
+  bool hasBranchMisses{false};
+};
+
+/*
+@brief Start or stop counting around the XOR kernels. Counting is off by
+default and then costs one relaxed atomic load per XOR call. Counters are
+opened per thread with perf_event_open (Linux), user space only, so a
+perf_event_paranoid of 2 still allows them.
+*/
+void enablePerfCounters(bool enable);
+
+/*
+@brief Check whether hardware counters were requested.
+*/
+bool perfCountersEnabled();
+
+/*
+@brief Counts the hardware events of the calling thread until its destruction.
+The counters of a thread are opened by its first scope and added to the
+process totals when the thread exits.
+*/
+class PerfScope {
+ public:
+  explicit PerfScope(size_t bytes);
+  PerfScope(const PerfScope&) = delete;
+  PerfScope& operator=(const PerfScope&) = delete;
+  ~PerfScope();
+
+ private:
+  bool active_{false};
+  size_t bytes_{0};
+};
+
+/*
+@brief Totals of the threads that have exited plus the calling thread.
+*/
+PerfCounts collectPerfCounters();
+
+/*
+@brief Format counters as a human-readable report with cycles and
+instructions per byte, or a note on why they are unavailable.
+*/
+std::string formatPerfCounters(const PerfCounts& counts);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+
+class PageCachePolicy;
+
+/*
+@brief XOR a stream with a reader thread, XOR workers and a writer thread.
+The stages exchange reusable chunk buffers through bounded lock-free
+single-producer/single-consumer rings, so reading, XORing and writing overlap.
+Chunks are dealt to the options.pipelineWorkers workers round-robin and
+collected in the same order, so output order is preserved. Descriptors are
+read and written sequentially and may be pipes.
+@param inputFd Descriptor to read from until end of input.
+@param outputFd Descriptor to write the XORed stream to.
+@param xorkey XOR key string.
+@param options Chunk size, key layout and number of XOR workers.
+@param cache Page-cache policy of the files behind the descriptors, released
+by the writer as chunks land (nullptr for pipes and terminals).
+@return Number of bytes processed.
+@throws std::runtime_error on IO errors (the first error of any stage).
+*/
+uint64_t runPipeline(int inputFd, int outputFd, std::string_view xorkey,
+                     const ProcessOptions& options,
+                     const PageCachePolicy* cache = nullptr);
+
+/*
+@brief Process a file with the three-stage pipeline (see runPipeline).
+@throws std::runtime_error on IO errors or if POSIX I/O is unavailable.
+*/
+void processFilePipeline(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options);
+
+#endif
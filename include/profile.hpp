@@ -0,0 +1,69 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include "constants.hpp"
+#include "functions.hpp"
+
+/*
+@brief Settings measured by --calibrate for the device holding a file.
+*/
+struct TuningProfile {
+  // Filesystem the profile was measured on (StorageInfo::volume)
+  std::string volume{};
+  size_t chunkSize{Constants::chunkSize};
+  unsigned threads{1};
+  IoBackend ioBackend{IoBackend::Stream};
+  // XOR kernel name, as accepted by selectXorKernel
+  std::string kernel{"auto"};
+};
+
+/*
+@brief Path of the profile file inside getConfigDir().
+*/
+std::string defaultProfilePath();
+
+/*
+@brief Format a profile as stored in the profile file, one line without the
+trailing newline, e.g. "volume=uuid:0b1c...@/home chunk=262144 threads=4
+backend=posix kernel=avx2".
+*/
+std::string formatProfile(const TuningProfile& profile);
+
+/*
+@brief Load the profile stored for a filesystem.
+Malformed lines, unknown settings and entries of earlier releases (keyed on a
+device number) are skipped, so a damaged profile file never stops a run.
+@param profilePath Profile file (see defaultProfilePath).
+@param volume Volume name of the input file (see probeStorage).
+@return The profile, or nothing if the file or the device entry is missing.
+*/
+std::optional<TuningProfile> loadProfile(const std::string& profilePath,
+                                         const std::string& volume);
+
+/*
+@brief Store a profile, replacing any previous entry for the same volume.
+@param profilePath Profile file; its directory is created if needed.
+@param profile Profile to store.
+@throws std::runtime_error if the profile file cannot be written.
+*/
+void saveProfile(const std::string& profilePath, const TuningProfile& profile);
+
+/*
+@brief Measure the best settings for the device holding a file (--calibrate).
+Times every supported XOR kernel in memory and several chunk sizes on the
+file. Then it copies up to calibrationSample bytes of the file next to it
+and times each I/O backend and thread count on that copy. The copy and its
+output are removed afterwards. The winning kernel stays selected.
+@param filename A regular file on the device to calibrate, ideally large.
+@throws std::runtime_error on I/O errors or without POSIX I/O.
+*/
+TuningProfile calibrateDevice(const std::string& filename);
+
+// Bytes of the input copied for the engine measurements of calibrateDevice
+inline constexpr uint64_t calibrationSample{64 * 1024 * 1024};
+
+#endif
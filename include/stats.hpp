@@ -0,0 +1,110 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+@brief Part of a run whose time and system calls --stats reports.
+*/
+enum class Stage {
+  Read,
+  Xor,
+  Write,
+  // fsync and sync_file_range of written data
+  Sync,
+  // Separate backup copies and the backup writes of fused runs
+  Backup,
+  Rename,
+};
+
+inline constexpr size_t stageCount{6};
+
+/*
+@brief Get the name of a stage ("read", "xor", "write", "fsync", "backup",
+"rename").
+*/
+std::string stageName(Stage stage);
+
+/*
+@brief Start or stop collecting statistics. Collection is off by default and
+then costs one relaxed atomic load per instrumented call.
+*/
+void enableStats(bool enable);
+
+/*
+@brief Check whether statistics are being collected.
+*/
+bool statsEnabled();
+
+/*
+@brief Clear every counter collected so far.
+*/
+void resetStats();
+
+/*
+@brief Count bytes run through the XOR kernels.
+*/
+void addProcessedBytes(uint64_t bytes);
+
+/*
+@brief Count one system call for the stage timed on the calling thread.
+Calls made outside a StageTimer are not counted.
+*/
+void countSyscall();
+
+/*
+@brief Adds the time until its destruction to a stage.
+Timers nest: inside a running timer (e.g. the backup writes of a fused run,
+which go through the regular write path), only the outermost one is
+recorded, and the system calls made inside are counted for its stage.
+*/
+class StageTimer {
+ public:
+  explicit StageTimer(Stage stage);
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+  ~StageTimer();
+
+ private:
+  bool outermost_{false};
+  Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/*
+@brief Statistics of a run, as reported by --stats.
+Stage times are summed over all threads, so multi-threaded runs can report
+more time per stage than wall time. Reads of the in-place engine are page
+faults and count as XOR time; the waits of the uring backend for completed
+reads and writes count as read time.
+*/
+struct RunStats {
+  uint64_t bytes{0};
+  double wallSeconds{0};
+  std::array<double, stageCount> stageSeconds{};
+  std::array<uint64_t, stageCount> syscalls{};
+  // Peak resident set size of the process in bytes (0 if unknown)
+  uint64_t peakRss{0};
+};
+
+/*
+@brief Snapshot the counters collected since the last reset.
+@param wallSeconds Wall time of the run, measured by the caller.
+*/
+RunStats collectStats(double wallSeconds);
+
+/*
+@brief Format statistics as a human-readable report, one line per item.
+*/
+std::string formatStats(const RunStats& stats);
+
+/*
+@brief Format statistics as a JSON object.
+*/
+std::string formatStatsJson(const RunStats& stats);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef STREAMING_HPP
+#define STREAMING_HPP
+
+#include <string>
+#include <string_view>
+#include "functions.hpp"
+
+/*
+@brief Check whether a path names a standard stream ("-").
+*/
+bool isStandardStream(const std::string& path);
+
+/*
+@brief XOR a stream where either side may be standard input/output ("-").
+Pipes are enlarged with F_SETPIPE_SZ where supported, and XORed chunks are
+handed to an output pipe with vmsplice instead of being copied by write.
+With options.pipelineWorkers set, the three-stage pipeline is used instead.
+@param filename Input file path, or "-" for standard input.
+@param outfile Output file path, or "-" for standard output.
+@param xorkey XOR key string.
+@param options Chunk size, key layout and pipeline workers.
+@throws std::runtime_error on IO errors.
+*/
+void processStreamInChunks(const std::string& filename,
+                           const std::string& outfile,
+                           std::string_view xorkey,
+                           const ProcessOptions& options);
+
+#endif
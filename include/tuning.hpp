@@ -0,0 +1,83 @@
+#ifndef TUNING_HPP
+#define TUNING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+@brief Kind of storage a file lives on, as far as chunk sizing is concerned.
+*/
+enum class StorageKind {
+  // Not detected (virtual filesystems, non-Linux systems)
+  Unknown,
+  // Spinning disk
+  Rotational,
+  // SSD or NVMe
+  SolidState,
+  // NFS, SMB/CIFS or Ceph mount
+  Network,
+};
+
+/*
+@brief What the filesystem reports about the storage behind a path.
+*/
+struct StorageInfo {
+  // Device number of the filesystem (st_dev), only stable within one boot
+  uint64_t device{0};
+  // Persistent name of the filesystem: "uuid:<UUID>@<mount point>", or
+  // "<source>@<mount point>" without a UUID; falls back to the device number
+  // qualified by the boot id (or alone, outside Linux). Empty if unknown
+  std::string volume{};
+  // Preferred I/O size (st_blksize)
+  size_t blockSize{0};
+  StorageKind kind{StorageKind::Unknown};
+};
+
+/*
+@brief Parse a --chunk-size value: a byte count with an optional K, M or G
+suffix (powers of 1024), or "auto".
+@return The size in bytes, or 0 for "auto".
+@throws std::runtime_error if the value is malformed, zero, or over 1 GiB.
+*/
+size_t parseChunkSize(const std::string& value);
+
+/*
+@brief Get the name of a storage kind ("unknown", "rotational", "ssd", "network").
+*/
+std::string storageKindName(StorageKind kind);
+
+/*
+@brief Inspect the filesystem and block device holding a file.
+@param filename Path to an existing file.
+@return The detected information; fields stay at their defaults when unknown.
+*/
+StorageInfo probeStorage(const std::string& filename);
+
+// Bytes read per candidate by calibrateChunkSize
+inline constexpr uint64_t calibrationWindow{4 * 1024 * 1024};
+
+/*
+@brief Time sequential reads of a file with each candidate chunk size.
+Each candidate reads its own calibrationWindow bytes of the file, so no
+candidate benefits from pages cached by another.
+@param filename File to read.
+@param candidates Chunk sizes to try.
+@return The fastest candidate, or 0 if the file is too small to tell.
+@throws std::runtime_error if the file cannot be read.
+*/
+size_t calibrateChunkSize(const std::string& filename,
+                          const std::vector<size_t>& candidates);
+
+/*
+@brief Pick a chunk size for processing a file (--chunk-size auto).
+Starts from the kind of storage (large chunks for network mounts and spinning
+disks, medium ones for SSDs), refines it with a short calibration run on large
+files, and keeps it a multiple of the preferred I/O size. Small files get a
+single chunk. Standard input gets Constants::chunkSize.
+@param filename Input path, or "-" for standard input.
+*/
+size_t autoChunkSize(const std::string& filename);
+
+#endif
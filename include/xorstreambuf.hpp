@@ -0,0 +1,80 @@
+#ifndef XORSTREAMBUF_HPP
+#define XORSTREAMBUF_HPP
+
+#include <cstdint>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+#include "constants.hpp"
+#include "dynoxor.hpp"
+
+/*
+@brief Stream buffer that XORs everything read from or written to another
+stream buffer, so iostream code reads and writes XORed data unchanged:
+
+  std::ifstream file("data.enc", std::ios::binary);
+  XorStreambuf decoded{file.rdbuf(), key};
+  std::istream in(&decoded);
+
+Data is XORed a whole buffer at a time, never per character. Reads of at
+least a buffer go straight into the caller's memory and are XORed there,
+without an extra copy. Seeking (including tellg/tellp) flushes pending
+output, drops buffered input and moves the key to the new position; seeks
+must name either the get or the put position, not both. A refused seek keeps
+the buffered input and the key, and so does a write after reads when inner
+cannot seek back to the reader's position (the write is refused).
+Output that inner refuses is kept, already XORed, and written first by the
+next flush, so a failed write can be retried after clearing the stream.
+Byte i of the underlying stream is keyed with key offset keyOffset + (i - p),
+where p is the position of the underlying stream at construction (0 for
+a freshly opened file), the layout written by processFileInChunks.
+The underlying buffer must outlive this one; pending output is flushed on
+destruction.
+*/
+class XorStreambuf : public std::streambuf {
+ public:
+  /*
+  @param inner Stream buffer holding the XORed data (e.g. file.rdbuf()).
+  @param key XOR key.
+  @param keyOffset Key offset of the current position of inner.
+  @param bufferSize Bytes buffered per read or write.
+  */
+  XorStreambuf(std::streambuf* inner, std::string_view key,
+               uint64_t keyOffset = 0,
+               size_t bufferSize = Constants::chunkSize);
+  XorStreambuf(const XorStreambuf&) = delete;
+  XorStreambuf& operator=(const XorStreambuf&) = delete;
+  ~XorStreambuf() override;
+
+ protected:
+  int_type underflow() override;
+  std::streamsize xsgetn(char* data, std::streamsize count) override;
+  int_type overflow(int_type ch) override;
+  int sync() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+
+ private:
+  // XOR and write the put area; false if inner refused some of it, which
+  // then stays at the start of the put area.
+  // Reading and writing alternate: only one of the areas is ever in use
+  bool flushOutput();
+  // Flush pending output and leave the put area for reading
+  bool startReading();
+  // Give unread input back to inner before writing; false, keeping the
+  // input, if inner cannot seek back
+  bool dropInput();
+
+  std::streambuf* inner_;
+  // Key position of the next byte read from or written to inner
+  XorStream stream_;
+  // Key offset minus position of inner, for positions returned by seeks
+  int64_t keyBase_{0};
+  // Bytes at the start of the put area XORed already, left by a short write
+  size_t encoded_{0};
+  std::vector<char> input_;
+  std::vector<char> output_;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "../include/backends.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include "../include/buffers.hpp"
+#include "../include/fileio.hpp"
+#include "../include/stats.hpp"
+
+IoBackend parseIoBackend(const std::string& name) {
+  if (name == "stream") {
+    return IoBackend::Stream;
+  }
+
+  if (name == "posix") {
+    return IoBackend::Posix;
+  }
+
+  if (name == "uring") {
+    return IoBackend::Uring;
+  }
+
+  throw std::runtime_error("Unknown I/O backend: " + name);
+}
+
+std::string ioBackendName(IoBackend backend) {
+  switch (backend) {
+    case IoBackend::Posix:
+      return "posix";
+    case IoBackend::Uring:
+      return "uring";
+    case IoBackend::Stream:
+      break;
+  }
+
+  return "stream";
+}
+
+#ifdef DYNOXOR_POSIX_IO
+
+void processFilePosix(const std::string& filename, const std::string& outfile,
+                      std::string_view xorkey, const ProcessOptions& options) {
+  FileHandle input{openInputFile(filename)};
+  FileHandle output{openOutputFile(outfile)};
+  FileHandle backup{openBackupFile(options.backupPath)};
+  const uint64_t size{fileSize(input)};
+  const PageCachePolicy cache{input, output, size, options.direct};
+  IoBuffer buffer{acquireBuffer(cache.chunkSize(options.chunkSize))};
+  uint64_t offset{0};
+
+  // Read, XOR and write one chunk at a time until end of file
+  while (true) {
+    const size_t bytesRead{
+        readAt(input, buffer.data(), buffer.size(), offset)};
+
+    if (!bytesRead) {
+      break;
+    }
+
+    if (backup) {
+      StageTimer timer{Stage::Backup};
+      writeAt(backup, buffer.data(), bytesRead, offset);
+    }
+
+    xorWithLayout(buffer.span().first(bytesRead), xorkey, offset, options);
+    writeAt(output, buffer.data(), cache.transferSize(bytesRead), offset);
+    cache.release(offset, bytesRead, 0, size);
+    offset += bytesRead;
+
+    // A short read means end of file, and only the last write may be padded
+    if (bytesRead < buffer.size()) {
+      break;
+    }
+  }
+
+  cache.finish(offset);
+}
+
+#else
+
+void processFilePosix(const std::string&, const std::string&,
+                      std::string_view, const ProcessOptions&) {
+  throw std::runtime_error("The posix I/O backend is unavailable here.");
+}
+
+#endif
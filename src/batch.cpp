@@ -0,0 +1,277 @@
+#include "../include/batch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../include/fileio.hpp"
+#include "../include/tuning.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// Output path for a file, relative to the argument it was found under
+std::string outputPathFor(const std::filesystem::path& file,
+                          const std::filesystem::path& relative,
+                          const std::string& outputDir) {
+  if (outputDir.empty()) {
+    return file.string();
+  }
+
+  return (std::filesystem::path(outputDir) / relative).string();
+}
+
+// Files this tool leaves next to an input: backups, temporary outputs and
+// journals (with their temporary copies) of a sibling that still exists, and
+// --calibrate samples. User files that merely share an extension are kept
+bool isWorkFile(const std::filesystem::path& file) {
+  const std::string name{file.filename().string()};
+
+  for (std::string_view suffix : {".calibrate.tmp", ".calibrate.out.tmp"}) {
+    if (name.size() > suffix.size() && name.ends_with(suffix)) {
+      return true;
+    }
+  }
+
+  for (std::string_view suffix : {".bak", ".tmp", ".journal", ".journal.tmp"}) {
+    std::error_code error;
+
+    if (name.size() > suffix.size() && name.ends_with(suffix) &&
+        std::filesystem::exists(
+            file.parent_path() / name.substr(0, name.size() - suffix.size()),
+            error)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Identity of a file: its device and inode where it exists, so symlinks and
+// hard links to one file match, else its path with symlinks resolved
+std::string fileIdentity(const std::string& path) {
+#ifdef DYNOXOR_POSIX_IO
+  struct stat info {};
+
+  if (::stat(path.c_str(), &info) == 0) {
+    return "inode " + std::to_string(info.st_dev) + ':' +
+           std::to_string(info.st_ino);
+  }
+#endif
+
+  std::error_code error;
+  std::filesystem::path resolved{
+      std::filesystem::weakly_canonical(path, error)};
+
+  if (error) {
+    resolved = std::filesystem::absolute(path).lexically_normal();
+  }
+
+  return "path " + resolved.string();
+}
+
+// A file written by one job and read or written by another, under the same
+// name or not, would be processed or overwritten concurrently. Inputs that
+// are only read may be shared
+void failSharedFiles(std::vector<BatchJob>& jobs) {
+  std::map<std::string, size_t> readers;
+  std::map<std::string, size_t> writers;
+  std::vector<std::pair<std::string, std::string>> identities;
+
+  for (const BatchJob& job : jobs) {
+    identities.emplace_back(fileIdentity(job.input), fileIdentity(job.output));
+    ++readers[identities.back().first];
+    ++writers[identities.back().second];
+  }
+
+  for (size_t i{0}; i < jobs.size(); ++i) {
+    const auto& [input, output] = identities[i];
+    // A job overwriting its input both reads and writes that file
+    const size_t own{input == output ? 1u : 0u};
+
+    if (writers[input] > own) {
+      jobs[i].error =
+          "Input " + jobs[i].input + " is shared with another output.";
+    } else if (writers[output] > 1 || readers[output] > own) {
+      jobs[i].error =
+          "Output " + jobs[i].output + " is shared with another input.";
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<std::string> readFileList(const std::string& listPath) {
+  std::ifstream list(listPath);
+
+  if (!list) {
+    throw std::runtime_error("Unable to open file list: " + listPath);
+  }
+
+  std::vector<std::string> paths;
+  std::string line;
+
+  while (std::getline(list, line)) {
+    // Tolerate lists written on Windows
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+
+    if (!line.empty()) {
+      paths.push_back(line);
+    }
+  }
+
+  return paths;
+}
+
+std::vector<BatchJob> collectBatchJobs(const std::vector<std::string>& paths,
+                                       const std::string& outputDir) {
+  std::vector<BatchJob> jobs;
+
+  for (const std::string& path : paths) {
+    std::filesystem::path root{path};
+    std::error_code error;
+
+    // Plain (or missing) files become jobs; missing ones fail when processed
+    if (!std::filesystem::is_directory(root, error)) {
+      uint64_t size{std::filesystem::file_size(root, error)};
+
+      jobs.push_back({path, outputPathFor(root, root.filename(), outputDir),
+                      error ? 0 : size});
+      continue;
+    }
+
+    // Entries that vanish or cannot be read while the tree is walked become
+    // failed jobs; unreadable directories are skipped
+    std::filesystem::recursive_directory_iterator it{
+        root, std::filesystem::directory_options::skip_permission_denied,
+        error};
+
+    for (; !error && it != std::filesystem::recursive_directory_iterator{};
+         it.increment(error)) {
+      const std::filesystem::directory_entry& entry{*it};
+      // Entries are built under root, so no lookup is needed here
+      const std::filesystem::path relative{
+          entry.path().lexically_relative(root)};
+      std::error_code entryError;
+      const bool regular{entry.is_regular_file(entryError)};
+      const uint64_t size{regular ? entry.file_size(entryError) : 0};
+
+      if (entryError) {
+        jobs.push_back({entry.path().string(),
+                        outputPathFor(entry.path(), relative, outputDir), 0,
+                        "Failed to inspect " + entry.path().string() + ": " +
+                            entryError.message()});
+        continue;
+      }
+
+      if (!regular || !size || isWorkFile(entry.path())) {
+        continue;
+      }
+
+      jobs.push_back({entry.path().string(),
+                      outputPathFor(entry.path(), relative, outputDir), size});
+    }
+
+    if (error) {
+      jobs.push_back({path, outputPathFor(root, root.filename(), outputDir), 0,
+                      "Failed to walk " + path + ": " + error.message()});
+    }
+  }
+
+  failSharedFiles(jobs);
+
+  // Largest first: long files start early, short ones fill the gaps
+  std::stable_sort(jobs.begin(), jobs.end(),
+                   [](const BatchJob& a, const BatchJob& b) {
+                     return a.size > b.size;
+                   });
+
+  return jobs;
+}
+
+std::vector<BatchFailure> runBatch(const std::vector<BatchJob>& jobs,
+                                   std::string_view xorkey,
+                                   const ProcessOptions& options,
+                                   const BatchOptions& batch) {
+  std::atomic<size_t> next{0};
+  std::mutex mutex;
+  std::vector<BatchFailure> failures;
+
+  auto worker{[&] {
+    for (size_t index{next++}; index < jobs.size(); index = next++) {
+      const BatchJob& job{jobs[index]};
+
+      if (!job.error.empty()) {
+        std::lock_guard<std::mutex> lock{mutex};
+        failures.push_back({job.input, job.error});
+        continue;
+      }
+
+      try {
+        verifyFile(job.input);
+
+        std::filesystem::path parent{
+            std::filesystem::path(job.output).parent_path()};
+
+        if (!parent.empty()) {
+          std::filesystem::create_directories(parent);
+        }
+
+        if (batch.keyLog) {
+          // The key log is shared by all workers
+          std::lock_guard<std::mutex> lock{mutex};
+          std::string key{xorkey};
+          std::string filename{job.input};
+          logKey(key, filename);
+        }
+
+        ProcessOptions fileOptions{options};
+
+        if (batch.autoChunkSize) {
+          fileOptions.chunkSize = autoChunkSize(job.input);
+        }
+
+        if (batch.backup) {
+          transformFileWithBackup(job.input, job.output, xorkey, fileOptions);
+        } else {
+          transformFile(job.input, job.output, xorkey, fileOptions);
+        }
+      } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock{mutex};
+        failures.push_back({job.input, e.what()});
+      }
+    }
+  }};
+
+  const size_t poolSize{std::clamp<size_t>(batch.jobs, 1,
+                                           std::max<size_t>(jobs.size(), 1))};
+  std::vector<std::thread> pool;
+
+  for (size_t i{1}; i < poolSize; ++i) {
+    pool.emplace_back(worker);
+  }
+
+  // The calling thread is the last worker of the pool
+  worker();
+
+  for (std::thread& thread : pool) {
+    thread.join();
+  }
+
+  return failures;
+}
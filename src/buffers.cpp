@@ -0,0 +1,205 @@
+#include "../include/buffers.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t minimumAlignment{4096};
+constexpr size_t hugePageSize{2 * 1024 * 1024};
+// Free blocks kept for reuse; blocks returned beyond this are released
+constexpr size_t maxPooledBlocks{64};
+
+size_t roundUp(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+size_t pageAlignment() {
+#if defined(__unix__) || defined(__APPLE__)
+  static const size_t pageSize{
+      std::max(static_cast<size_t>(::sysconf(_SC_PAGESIZE)), minimumAlignment)};
+
+  return pageSize;
+#else
+  return minimumAlignment;
+#endif
+}
+
+IoBuffer::Block allocateAligned(size_t size, size_t alignment) {
+  const size_t capacity{roundUp(size, alignment)};
+
+  return {static_cast<char*>(
+              ::operator new(capacity, std::align_val_t{alignment})),
+          capacity, alignment};
+}
+
+IoBuffer::Block allocateBlock(size_t size, HugePages mode) {
+#ifdef __linux__
+  if (mode == HugePages::Explicit) {
+    const size_t capacity{roundUp(size, hugePageSize)};
+    void* data{::mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)};
+
+    // An empty hugetlb pool is not an error; use regular pages instead
+    if (data != MAP_FAILED) {
+      return {static_cast<char*>(data), capacity, 0};
+    }
+  }
+
+#ifdef MADV_HUGEPAGE
+  // Only buffers spanning a whole huge page can be backed by one
+  if (mode == HugePages::Transparent && size >= hugePageSize) {
+    IoBuffer::Block block{allocateAligned(size, hugePageSize)};
+    ::madvise(block.data, block.capacity, MADV_HUGEPAGE);
+
+    return block;
+  }
+#endif
+#else
+  (void)mode;
+#endif
+
+  return allocateAligned(size, pageAlignment());
+}
+
+void freeBlock(const IoBuffer::Block& block) {
+#ifdef __linux__
+  if (!block.alignment) {
+    ::munmap(block.data, block.capacity);
+    return;
+  }
+#endif
+
+  ::operator delete(block.data, std::align_val_t{block.alignment});
+}
+
+// Process-wide free list of buffers, shared by every thread
+class BufferPool {
+ public:
+  BufferPool() = default;
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  ~BufferPool() {
+    for (const IoBuffer::Block& block : free_) {
+      freeBlock(block);
+    }
+  }
+
+  IoBuffer::Block take(size_t size) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      // Best fit, so small requests do not hold on to large buffers; among
+      // equal fits the most recently returned (cache-warm) buffer wins
+      auto best{free_.rend()};
+
+      for (auto it{free_.rbegin()}; it != free_.rend(); ++it) {
+        if (it->capacity >= size &&
+            (best == free_.rend() || it->capacity < best->capacity)) {
+          best = it;
+        }
+      }
+
+      if (best != free_.rend()) {
+        IoBuffer::Block block{*best};
+        free_.erase(std::next(best).base());
+
+        return block;
+      }
+    }
+
+    return allocateBlock(size, mode_.load(std::memory_order_relaxed));
+  }
+
+  void give(const IoBuffer::Block& block) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+
+      if (free_.size() < maxPooledBlocks) {
+        free_.push_back(block);
+        return;
+      }
+    }
+
+    freeBlock(block);
+  }
+
+  void setMode(HugePages mode) { mode_ = mode; }
+
+ private:
+  std::mutex mutex_;
+  std::vector<IoBuffer::Block> free_;
+  std::atomic<HugePages> mode_{HugePages::Off};
+};
+
+BufferPool& pool() {
+  static BufferPool instance;
+
+  return instance;
+}
+
+}  // namespace
+
+IoBuffer::IoBuffer(IoBuffer&& other) noexcept
+    : block_(std::exchange(other.block_, {})),
+      size_(std::exchange(other.size_, 0)) {}
+
+IoBuffer& IoBuffer::operator=(IoBuffer&& other) noexcept {
+  if (this != &other) {
+    if (block_.data) {
+      pool().give(block_);
+    }
+
+    block_ = std::exchange(other.block_, {});
+    size_ = std::exchange(other.size_, 0);
+  }
+
+  return *this;
+}
+
+IoBuffer::~IoBuffer() {
+  if (block_.data) {
+    pool().give(block_);
+  }
+}
+
+IoBuffer acquireBuffer(size_t size) {
+  size = std::max<size_t>(size, 1);
+
+  return IoBuffer{pool().take(size), size};
+}
+
+HugePages parseHugePages(const std::string& name) {
+  if (name == "off") {
+    return HugePages::Off;
+  }
+
+  if (name == "transparent") {
+    return HugePages::Transparent;
+  }
+
+  if (name == "explicit") {
+    return HugePages::Explicit;
+  }
+
+  throw std::runtime_error("Unknown huge page mode: " + name);
+}
+
+void setHugePages(HugePages mode) {
+  pool().setMode(mode);
+}
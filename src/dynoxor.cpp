@@ -0,0 +1,128 @@
+#include "../include/dynoxor.hpp"
+#include "../include/fileio.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Copy and XOR in blocks that stay in L2, instead of two passes over memory
+constexpr size_t copyBlock{64 * 1024};
+
+std::span<char> asChars(std::span<std::byte> data) {
+  return {reinterpret_cast<char*>(data.data()), data.size()};
+}
+
+// Copy source to destination, then XOR it in place with transform(block,
+// position of the block in source)
+template <typename Transform>
+void copyAndTransform(std::span<const std::byte> source,
+                      std::span<std::byte> destination, const char* caller,
+                      Transform&& transform) {
+  if (source.size() != destination.size()) {
+    throw std::invalid_argument(std::string(caller) +
+                                ": source and destination sizes differ.");
+  }
+
+  // Front to back is only safe for a destination that does not start inside
+  // the source; overlapping the other way goes block by block from the end
+  const bool backwards{destination.data() > source.data() &&
+                       destination.data() < source.data() + source.size()};
+  const size_t blocks{(source.size() + copyBlock - 1) / copyBlock};
+
+  for (size_t i{0}; i < blocks; ++i) {
+    const size_t block{backwards ? blocks - 1 - i : i};
+    const size_t begin{block * copyBlock};
+    const size_t len{std::min(copyBlock, source.size() - begin)};
+
+    std::memmove(destination.data() + begin, source.data() + begin, len);
+    transform(destination.subspan(begin, len), begin);
+  }
+}
+
+}  // namespace
+
+void xorBytes(std::span<std::byte> data, std::string_view key,
+              uint64_t keyOffset) {
+  xorRange(asChars(data), key, keyOffset);
+}
+
+void xorBytes(std::span<const std::byte> source,
+              std::span<std::byte> destination, std::string_view key,
+              uint64_t keyOffset) {
+  copyAndTransform(source, destination, "xorBytes",
+                   [&](std::span<std::byte> block, size_t position) {
+                     xorBytes(block, key, keyOffset + position);
+                   });
+}
+
+size_t readRange(const std::string& filename, std::span<std::byte> destination,
+                 std::string_view key, uint64_t offset) {
+  char* data{reinterpret_cast<char*>(destination.data())};
+
+#ifdef DYNOXOR_POSIX_IO
+  const size_t len{
+      readAt(openInputFile(filename), data, destination.size(), offset)};
+#else
+  std::ifstream file(filename, std::ios::binary);
+
+  if (!file) {
+    throw std::runtime_error("Failed to open input file " + filename);
+  }
+
+  file.seekg(static_cast<std::streamoff>(offset));
+  file.read(data, static_cast<std::streamsize>(destination.size()));
+  const size_t len{static_cast<size_t>(file.gcount())};
+#endif
+
+  xorBytes(destination.first(len), key, offset);
+
+  return len;
+}
+
+XorStream::XorStream(std::string_view key, uint64_t offset)
+    : schedule_(std::make_shared<const Schedule>(
+          Schedule{std::string(key), expandKey(key)})),
+      offset_(offset) {}
+
+XorStream::XorStream(XorStream&& other) noexcept
+    : schedule_(std::move(other.schedule_)),
+      offset_(std::exchange(other.offset_, 0)) {}
+
+XorStream& XorStream::operator=(XorStream&& other) noexcept {
+  schedule_ = std::move(other.schedule_);
+  offset_ = std::exchange(other.offset_, 0);
+
+  return *this;
+}
+
+void XorStream::transform(std::span<char> data, uint64_t offset) const {
+  if (!schedule_ || schedule_->key.empty()) {
+    return;
+  }
+
+  const std::string& key{schedule_->key};
+  // Reduce in 64 bits so offsets past 4 GiB stay exact on 32-bit targets
+  xorBufferExpanded(data.data(), data.size(), key, schedule_->block,
+                    static_cast<size_t>(offset % key.size()));
+}
+
+void XorStream::apply(std::span<char> data) {
+  transform(data, offset_);
+  offset_ += data.size();
+}
+
+void XorStream::apply(std::span<std::byte> data) {
+  apply(asChars(data));
+}
+
+void XorStream::apply(std::span<const std::byte> source,
+                      std::span<std::byte> destination) {
+  copyAndTransform(source, destination, "XorStream::apply",
+                   [&](std::span<std::byte> block, size_t position) {
+                     transform(asChars(block), offset_ + position);
+                   });
+  offset_ += source.size();
+}
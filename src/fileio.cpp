@@ -0,0 +1,366 @@
+#include "../include/fileio.hpp"
+#include <algorithm>
+#include "../include/stats.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Build an error message carrying the errno description
+std::runtime_error ioError(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Turn uncached I/O on or off for a descriptor; false if it is refused
+bool setDirectIo(const FileHandle& file, bool enable) {
+#if defined(O_DIRECT)
+  const int flags{::fcntl(file.get(), F_GETFL)};
+
+  return flags >= 0 &&
+         ::fcntl(file.get(), F_SETFL,
+                 enable ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+#elif defined(F_NOCACHE)
+  return ::fcntl(file.get(), F_NOCACHE, enable ? 1 : 0) == 0;
+#else
+  (void)file;
+  return !enable;
+#endif
+}
+
+}  // namespace
+
+FileHandle::FileHandle(FileHandle&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)) {}
+
+FileHandle& FileHandle::operator=(FileHandle&& other) noexcept {
+  if (this != &other) {
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+
+    fd_ = std::exchange(other.fd_, -1);
+  }
+
+  return *this;
+}
+
+FileHandle::~FileHandle() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+FileHandle openInputFile(const std::string& filename) {
+  FileHandle file{::open(filename.c_str(), O_RDONLY | O_CLOEXEC)};
+
+  if (!file) {
+    throw ioError("Failed to open input file " + filename);
+  }
+
+  return file;
+}
+
+FileHandle openOutputFile(const std::string& filename) {
+  FileHandle file{
+      ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+
+  if (!file) {
+    throw ioError("Failed to open output file " + filename);
+  }
+
+  return file;
+}
+
+FileHandle openReadWriteFile(const std::string& filename) {
+  FileHandle file{::open(filename.c_str(), O_RDWR | O_CLOEXEC)};
+
+  if (!file) {
+    throw ioError("Failed to open file for in-place update " + filename);
+  }
+
+  return file;
+}
+
+FileHandle openBackupFile(const std::string& backupPath) {
+  if (backupPath.empty()) {
+    return FileHandle{};
+  }
+
+  return openOutputFile(backupPath);
+}
+
+PageCachePolicy::PageCachePolicy(const FileHandle& input,
+                                 const FileHandle& output, uint64_t size,
+                                 bool direct)
+    : input_(input), output_(output), size_(size), requestedDirect_(direct) {
+  if (requestedDirect_) {
+    // Some filesystems (some FUSE and network mounts) refuse O_DIRECT
+    direct_ = setDirectIo(input_, true) && setDirectIo(output_, true);
+
+    if (!direct_) {
+      setDirectIo(input_, false);
+      setDirectIo(output_, false);
+    }
+  }
+
+  // Reserve the extents up front: less fragmentation, no allocation stalls.
+  // Outputs that cannot be sized (devices, pipes) are written as they are
+#ifdef __linux__
+  preallocated_ =
+      size && (::fallocate(output_.get(), 0, 0, static_cast<off_t>(size)) ==
+                   0 ||
+               ::ftruncate(output_.get(), static_cast<off_t>(size)) == 0);
+#else
+  preallocated_ =
+      size && ::ftruncate(output_.get(), static_cast<off_t>(size)) == 0;
+#endif
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (!direct_) {
+    ::posix_fadvise(input_.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+#endif
+}
+
+size_t PageCachePolicy::chunkSize(size_t requested) const {
+  if (!direct_) {
+    return requested;
+  }
+
+  return std::max<size_t>((requested + directAlignment - 1) / directAlignment,
+                          1) *
+         directAlignment;
+}
+
+size_t PageCachePolicy::transferSize(size_t len) const {
+  return direct_ ? chunkSize(len) : len;
+}
+
+void PageCachePolicy::release(uint64_t offset, size_t len,
+                              uint64_t rangeBegin, uint64_t rangeEnd) const {
+  const uint64_t end{offset + len};
+
+  // One set of calls per stride, plus one at the end of the range
+  if (direct_ ||
+      (end / releaseStride == offset / releaseStride && end < rangeEnd)) {
+    return;
+  }
+
+  // Strides completed by this chunk (several for chunks over a stride)
+  const uint64_t windowBegin{
+      std::max(rangeBegin, offset / releaseStride * releaseStride)};
+  const uint64_t windowEnd{
+      end < rangeEnd ? end / releaseStride * releaseStride : end};
+  const off_t windowLen{static_cast<off_t>(windowEnd - windowBegin)};
+
+  StageTimer timer{Stage::Sync};
+
+#ifdef POSIX_FADV_DONTNEED
+  // Input pages are clean and can go at once
+  countSyscall();
+  ::posix_fadvise(input_.get(), static_cast<off_t>(windowBegin), windowLen,
+                  POSIX_FADV_DONTNEED);
+#endif
+
+  // Dirty output pages cannot be dropped before they are written back
+  uint64_t dropBegin{windowBegin};
+  uint64_t dropEnd{windowEnd};
+
+#ifdef __linux__
+  if (requestedDirect_) {
+    // --direct without O_DIRECT: keep the output out of the cache at the
+    // price of waiting for its writeback
+    countSyscall();
+    ::sync_file_range(output_.get(), static_cast<off_t>(windowBegin),
+                      windowLen,
+                      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                          SYNC_FILE_RANGE_WAIT_AFTER);
+  } else {
+    // Start writeback now, and drop the window queued by the previous
+    // release, whose writeback has had time to complete (pages still in
+    // flight are simply kept). That window is a stride, or a whole chunk for
+    // chunks over a stride such as the in-place engine's mapped windows
+    countSyscall();
+    ::sync_file_range(output_.get(), static_cast<off_t>(windowBegin),
+                      windowLen, SYNC_FILE_RANGE_WRITE);
+
+    const uint64_t lag{
+        std::max<uint64_t>(releaseStride, windowEnd - windowBegin)};
+    dropEnd = windowBegin;
+    dropBegin =
+        std::max(rangeBegin, windowBegin >= lag ? windowBegin - lag : 0);
+
+    if (dropBegin >= dropEnd) {
+      return;
+    }
+  }
+#else
+  // Without sync_file_range only --direct pays for a flush
+  if (!requestedDirect_) {
+    return;
+  }
+
+  countSyscall();
+  ::fsync(output_.get());
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+  countSyscall();
+  ::posix_fadvise(output_.get(), static_cast<off_t>(dropBegin),
+                  static_cast<off_t>(dropEnd - dropBegin),
+                  POSIX_FADV_DONTNEED);
+#endif
+}
+
+void PageCachePolicy::finish(uint64_t size) const {
+  if ((direct_ || preallocated_) &&
+      ::ftruncate(output_.get(), static_cast<off_t>(size)) != 0) {
+    throw ioError("Failed to trim output file");
+  }
+}
+
+uint64_t fileSize(const FileHandle& file) {
+  struct stat info {};
+
+  if (::fstat(file.get(), &info) != 0) {
+    throw ioError("Failed to stat file");
+  }
+
+  return static_cast<uint64_t>(info.st_size);
+}
+
+size_t readAt(const FileHandle& file, char* data, size_t len,
+              uint64_t offset) {
+  StageTimer timer{Stage::Read};
+  size_t done{0};
+
+  while (done < len) {
+    countSyscall();
+    ssize_t n{::pread(file.get(), data + done, len - done,
+                      static_cast<off_t>(offset + done))};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw ioError("Failed reading input file");
+    }
+
+    // End of file reached
+    if (!n) {
+      break;
+    }
+
+    done += static_cast<size_t>(n);
+  }
+
+  return done;
+}
+
+void writeAt(const FileHandle& file, const char* data, size_t len,
+             uint64_t offset) {
+  StageTimer timer{Stage::Write};
+  size_t done{0};
+
+  while (done < len) {
+    countSyscall();
+    ssize_t n{::pwrite(file.get(), data + done, len - done,
+                       static_cast<off_t>(offset + done))};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw ioError("Failed writing to output file");
+    }
+
+    done += static_cast<size_t>(n);
+  }
+}
+
+void syncPath(const std::string& filename) {
+  FileHandle file{openInputFile(filename)};
+
+  {
+    StageTimer timer{Stage::Sync};
+    countSyscall();
+
+    if (::fsync(file.get()) != 0) {
+      throw ioError("Failed to sync " + filename);
+    }
+  }
+
+  syncParentDirectory(filename);
+}
+
+void syncParentDirectory(const std::string& filename) {
+  std::filesystem::path dir{std::filesystem::path(filename).parent_path()};
+  FileHandle handle{::open(dir.empty() ? "." : dir.c_str(),
+                           O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+
+  if (handle) {
+    StageTimer timer{Stage::Sync};
+    countSyscall();
+    ::fsync(handle.get());
+  }
+}
+
+size_t readFull(int fd, char* data, size_t len) {
+  StageTimer timer{Stage::Read};
+  size_t done{0};
+
+  while (done < len) {
+    countSyscall();
+    ssize_t n{::read(fd, data + done, len - done)};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw ioError("Failed reading input");
+    }
+
+    // End of input reached
+    if (!n) {
+      break;
+    }
+
+    done += static_cast<size_t>(n);
+  }
+
+  return done;
+}
+
+void writeFull(int fd, const char* data, size_t len) {
+  StageTimer timer{Stage::Write};
+  size_t done{0};
+
+  while (done < len) {
+    countSyscall();
+    ssize_t n{::write(fd, data + done, len - done)};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      throw ioError("Failed writing output");
+    }
+
+    done += static_cast<size_t>(n);
+  }
+}
+
+#endif
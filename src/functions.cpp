@@ -1,13 +1,40 @@
 #include "../include/functions.hpp"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <ios>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <span>
 #include <stdexcept>
+#include "../include/backends.hpp"
+#include "../include/buffers.hpp"
 #include "../include/constants.hpp"
+#include "../include/fileio.hpp"
+#include "../include/inplace.hpp"
+#include "../include/kernels.hpp"
+#include "../include/parallel.hpp"
+#include "../include/perfcounters.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/stats.hpp"
+#include "../include/streaming.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 std::string getConfigDir() {
 #ifdef compute_win32_argv
@@ -38,9 +65,76 @@ std::string getConfigDir() {
 #endif
 }
 
+void xorWithLayout(std::span<char> data, std::string_view xorkey,
+                   uint64_t offset, const ProcessOptions& options) {
+  StageTimer timer{Stage::Xor};
+  PerfScope counters{data.size()};
+  addProcessedBytes(data.size());
+
+  if (!options.legacyKeyPhase) {
+    xorRange(data, xorkey, offset);
+    return;
+  }
+
+  // Legacy layout: the key restarts at every multiple of the chunk size
+  const uint64_t chunkSize{std::max<uint64_t>(options.chunkSize, 1)};
+
+  while (!data.empty()) {
+    const uint64_t phase{offset % chunkSize};
+    const size_t len{static_cast<size_t>(
+        std::min<uint64_t>(data.size(), chunkSize - phase))};
+
+    xorRange(data.first(len), xorkey, phase);
+    data = data.subspan(len);
+    offset += len;
+  }
+}
+
 void processFileInChunks(const std::string& filename,
-                         const std::string& outfile, const std::string& xorkey,
+                         const std::string& outfile, std::string_view xorkey,
                          size_t chunkSize) {
+  processFileInChunks(filename, outfile, xorkey,
+                      ProcessOptions{.chunkSize = chunkSize});
+}
+
+void processFileInChunks(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options) {
+  // Standard streams cannot be sized or seeked, so they have their own loop
+  if (isStandardStream(filename) || isStandardStream(outfile)) {
+    processStreamInChunks(filename, outfile, xorkey, options);
+    return;
+  }
+
+#ifdef DYNOXOR_POSIX_IO
+  // Split large jobs across threads using positioned reads and writes
+  if (options.threads > 1) {
+    processFileParallel(filename, outfile, xorkey, options);
+    return;
+  }
+
+  // Overlap reading, XORing and writing on separate threads
+  if (options.pipelineWorkers > 0 && !options.direct) {
+    processFilePipeline(filename, outfile, xorkey, options);
+    return;
+  }
+
+  if (options.ioBackend == IoBackend::Uring && !options.direct) {
+    if (uringSupported()) {
+      processFileUring(filename, outfile, xorkey, options);
+      return;
+    }
+
+    std::cerr << "io_uring is unavailable, using the posix I/O backend.\n";
+  }
+
+  // Direct I/O needs the aligned, positioned transfers of the posix backend
+  if (options.ioBackend != IoBackend::Stream || options.direct) {
+    processFilePosix(filename, outfile, xorkey, options);
+    return;
+  }
+#endif
+
   // Open input file stream in binary mode for reading
   std::ifstream input(filename, std::ios::binary);
 
@@ -55,37 +149,234 @@ void processFileInChunks(const std::string& filename,
     throw std::runtime_error("Failed to open output file.");
   }
 
-  // Prepare buffer to hold file chunks
-  std::string buffer(chunkSize, '\0');
-  // Cache key length to avoid repeated calls in loop
-  size_t keyLen{xorkey.size()};
+#ifdef DYNOXOR_POSIX_IO
+  // The page-cache hints act on the files, so descriptors of their own serve
+  // the streams; the output is opened once the stream has truncated it
+  FileHandle cacheInput{openInputFile(filename)};
+  FileHandle cacheOutput{openOutputFile(outfile)};
+  const PageCachePolicy cache{cacheInput, cacheOutput, fileSize(cacheInput),
+                              false};
+#endif
+
+  // Fused backup receives every chunk before it is XORed
+  std::ofstream backup;
+
+  if (!options.backupPath.empty()) {
+    backup.open(options.backupPath, std::ios::binary);
+
+    if (!backup) {
+      throw std::runtime_error("Error opening backup file for writing: " +
+                               options.backupPath);
+    }
+  }
+
+  // Reusable, uninitialized buffer to hold file chunks
+  IoBuffer buffer{acquireBuffer(options.chunkSize)};
+  // Absolute offset of the current chunk within the input file
+  uint64_t offset{0};
 
   // Read input file chunk-by-chunk until EOF or error
   while (input) {
-    // Read up to chunkSize bytes into buffer
-    input.read(&buffer[0], buffer.size());
-    // Get number of bytes actually read ( may be less at end )
-    std::streamsize bytesRead{input.gcount()};
+    std::streamsize bytesRead{0};
+
+    {
+      // Chunks larger than the stream buffer are one read call each
+      StageTimer timer{Stage::Read};
+      countSyscall();
+      // Read up to chunkSize bytes into buffer
+      input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      // Get number of bytes actually read ( may be less at end )
+      bytesRead = input.gcount();
+    }
 
     if (!bytesRead) {
       break;
     }
 
-    // XOR each byte of the read chunk with the XOR key (cycling through key)
-    for (std::streamsize i{0}; i < bytesRead; ++i) {
-      buffer[i] ^= xorkey[i % keyLen];
+    if (backup.is_open()) {
+      StageTimer timer{Stage::Backup};
+      countSyscall();
+
+      if (!backup.write(buffer.data(), bytesRead)) {
+        throw std::runtime_error("Error writing backup file: " +
+                                 options.backupPath);
+      }
+    }
+
+    // XOR the read chunk, keyed on its file offset
+    xorWithLayout(buffer.span().first(static_cast<size_t>(bytesRead)),
+                  xorkey, offset, options);
+    offset += static_cast<uint64_t>(bytesRead);
+
+    {
+      // Write the XORed chunk to the output file
+      StageTimer timer{Stage::Write};
+      countSyscall();
+      output.write(buffer.data(), bytesRead);
+
+      if (!output) {
+        throw std::runtime_error("Failed writing to output file.");
+      }
+    }
+
+#ifdef DYNOXOR_POSIX_IO
+    // Release once a stride or the file is complete, after handing whatever
+    // the stream still buffers to the kernel
+    const uint64_t stride{PageCachePolicy::releaseStride};
+    const uint64_t chunkBegin{offset - static_cast<uint64_t>(bytesRead)};
+
+    if (chunkBegin / stride != offset / stride || offset >= cache.size()) {
+      if (!output.flush()) {
+        throw std::runtime_error("Failed writing to output file.");
+      }
+
+      cache.release(chunkBegin, static_cast<size_t>(bytesRead), 0,
+                    cache.size());
+    }
+#endif
+  }
+
+#ifdef DYNOXOR_POSIX_IO
+  if (!output.flush()) {
+    throw std::runtime_error("Failed writing to output file.");
+  }
+
+  cache.finish(offset);
+#endif
+}
+
+void transformFile(const std::string& filename, const std::string& outfile,
+                   std::string_view xorkey, const ProcessOptions& options) {
+  const bool overwrite{filename == outfile && !isStandardStream(filename)};
+
+#ifdef DYNOXOR_POSIX_IO
+  // Overwrite runs XOR the mapped file in place, without a temporary copy
+  // (direct runs keep using the temporary file below, since a mapping always
+  // goes through the page cache). A read-only file in a writable directory
+  // cannot be mapped for writing, but can still be replaced by a rename.
+  // A fused backup is only safe while the input is left untouched, so it
+  // goes through the temporary file as well
+  if (overwrite && !options.direct && options.backupPath.empty() &&
+      ::access(filename.c_str(), W_OK) == 0) {
+    processFileInPlace(filename, xorkey, options);
+    return;
+  }
+#endif
+
+  if (!overwrite) {
+    processFileInChunks(filename, outfile, xorkey, options);
+    return;
+  }
+
+  // Write to a temp file and rename it over the input to avoid data loss
+  std::string tempFileName{filename + ".tmp"};
+  processFileInChunks(filename, tempFileName, xorkey, options);
+
+  try {
+    StageTimer timer{Stage::Rename};
+    countSyscall();
+    std::filesystem::rename(tempFileName, outfile);
+  } catch (const std::filesystem::filesystem_error& e) {
+    throw std::runtime_error(std::string("Error renaming temporary file: ") +
+                             e.what() +
+                             "\nTemporary file left as: " + tempFileName);
+  }
+}
+
+void transformRange(const std::string& filename, const std::string& outfile,
+                    std::string_view xorkey, uint64_t offset,
+                    uint64_t length, const ProcessOptions& options) {
+  if (isStandardStream(filename)) {
+    throw std::runtime_error(
+        "A range cannot be read from standard input, which cannot seek.");
+  }
+
+  // Opening the output truncates it, so it must not be the input
+  std::error_code error;
+
+  if (filename == outfile ||
+      std::filesystem::equivalent(filename, outfile, error)) {
+    throw std::runtime_error(
+        "A range cannot be written over its input file; choose an output.");
+  }
+
+  IoBuffer buffer{acquireBuffer(options.chunkSize)};
+
+#ifdef DYNOXOR_POSIX_IO
+  FileHandle input{openInputFile(filename)};
+  const uint64_t size{fileSize(input)};
+  FileHandle output;
+
+  if (!isStandardStream(outfile)) {
+    output = openOutputFile(outfile);
+  }
+
+  const int outputFd{output ? output.get() : STDOUT_FILENO};
+#else
+  std::ifstream input(filename, std::ios::binary);
+
+  if (!input) {
+    throw std::runtime_error("Failed to open input file.");
+  }
+
+  const uint64_t size{std::filesystem::file_size(filename)};
+  // C stdio is used so the data bypasses std::cout, which main may redirect
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> outputFile{
+      isStandardStream(outfile) ? nullptr : std::fopen(outfile.c_str(), "wb"),
+      &std::fclose};
+  std::FILE* output{isStandardStream(outfile) ? stdout : outputFile.get()};
+
+  if (!output) {
+    throw std::runtime_error("Failed to open output file.");
+  }
+
+  input.seekg(static_cast<std::streamoff>(std::min(offset, size)));
+#endif
+
+  const uint64_t end{offset +
+                     std::min(length, size - std::min(offset, size))};
+
+  // Each chunk is read at its own offset: nothing before the range is touched
+  while (offset < end) {
+    const size_t want{static_cast<size_t>(
+        std::min<uint64_t>(buffer.size(), end - offset))};
+
+#ifdef DYNOXOR_POSIX_IO
+    const size_t len{readAt(input, buffer.data(), want, offset)};
+#else
+    input.read(buffer.data(), static_cast<std::streamsize>(want));
+    const size_t len{static_cast<size_t>(input.gcount())};
+#endif
+
+    // The file shrank while it was read
+    if (!len) {
+      break;
     }
 
-    // Write the XORed chunk to the output file
-    output.write(buffer.data(), bytesRead);
+    xorWithLayout(buffer.span().first(len), xorkey, offset, options);
+    offset += len;
 
-    if (!output) {
+#ifdef DYNOXOR_POSIX_IO
+    writeFull(outputFd, buffer.data(), len);
+#else
+    if (std::fwrite(buffer.data(), 1, len, output) != len) {
       throw std::runtime_error("Failed writing to output file.");
     }
+#endif
+  }
+
+#ifndef DYNOXOR_POSIX_IO
+  if (std::fflush(output) != 0) {
+    throw std::runtime_error("Failed writing to output file.");
   }
+#endif
 }
 
 void verifyFile(const std::string& filename) {
+  if (isStandardStream(filename)) {
+    return;
+  }
+
   // Open file in binary mode, starting at end to obtain file size easily
   std::ifstream file(filename, std::ios::binary | std::ios::ate);
 
@@ -158,7 +449,8 @@ void generateKey(std::string& xorkey) {
 void verifyKey(std::string& xorkey, bool generate) {
   if ((generate && !xorkey.empty()) || (!generate && xorkey.empty())) {
     throw std::runtime_error(
-        "Error: you must specify either --key or --generate, but not both.");
+        "Error: you must specify either --key (or --key-file) or --generate, "
+        "but not both.");
   }
 
   if (!generate) {
@@ -194,7 +486,176 @@ void verifyOutfile(std::string& outfile, std::string& filename,
   }
 }
 
-void backupFile(const std::string& filename) {
+std::string backupMethodName(BackupMethod method) {
+  switch (method) {
+    case BackupMethod::Reflink:
+      return "reflink";
+    case BackupMethod::CopyFileRange:
+      return "copy_file_range";
+    case BackupMethod::Fused:
+      return "fused";
+    case BackupMethod::Stream:
+      break;
+  }
+
+  return "stream";
+}
+
+#ifdef __linux__
+
+namespace {
+
+// Open the original and (truncated) backup files for a kernel-side copy
+void openBackupPair(const std::string& filename, const std::string& backupName,
+                    FileHandle& source, FileHandle& backup) {
+  source = FileHandle{::open(filename.c_str(), O_RDONLY | O_CLOEXEC)};
+
+  if (!source) {
+    throw std::runtime_error("Error opening original file for backup: " +
+                             filename);
+  }
+
+  backup = FileHandle{::open(backupName.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+
+  if (!backup) {
+    throw std::runtime_error("Error opening backup file for writing: " +
+                             backupName);
+  }
+}
+
+// Share the extents on copy-on-write filesystems; false if unsupported
+bool reflinkCopy(const std::string& filename, const std::string& backupName) {
+  FileHandle source;
+  FileHandle backup;
+  openBackupPair(filename, backupName, source, backup);
+  countSyscall();
+
+  return ::ioctl(backup.get(), FICLONE, source.get()) == 0;
+}
+
+// Copy with the kernel's help; false if the filesystem offers neither a
+// reflink nor copy_file_range, in which case nothing was copied
+bool kernelCopy(const std::string& filename, const std::string& backupName,
+                BackupMethod& method) {
+  FileHandle source;
+  FileHandle backup;
+  openBackupPair(filename, backupName, source, backup);
+  countSyscall();
+
+  if (::ioctl(backup.get(), FICLONE, source.get()) == 0) {
+    method = BackupMethod::Reflink;
+    return true;
+  }
+
+  uint64_t copied{0};
+
+  while (true) {
+    countSyscall();
+    ssize_t n{::copy_file_range(source.get(), nullptr, backup.get(), nullptr,
+                                size_t{1} << 30, 0)};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      // Unsupported here (cross-device, old kernel, special file)
+      if (!copied && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                      errno == EOPNOTSUPP)) {
+        return false;
+      }
+
+      throw std::runtime_error("Error writing backup file: " + backupName);
+    }
+
+    if (!n) {
+      break;
+    }
+
+    copied += static_cast<uint64_t>(n);
+  }
+
+  method = BackupMethod::CopyFileRange;
+  return true;
+}
+
+}  // namespace
+
+#endif
+
+BackupMethod transformFileWithBackup(const std::string& filename,
+                                     const std::string& outfile,
+                                     std::string_view xorkey,
+                                     const ProcessOptions& options) {
+  const std::string backupName{filename + ".bak"};
+
+#ifdef __linux__
+  bool cloned{false};
+
+  {
+    StageTimer timer{Stage::Backup};
+    cloned = reflinkCopy(filename, backupName);
+  }
+
+  if (cloned) {
+    std::cout << "Backup created (reflink): " << backupName << '\n';
+  }
+#endif
+
+  std::error_code error;
+  const bool overwrite{filename == outfile ||
+                       std::filesystem::equivalent(filename, outfile, error)};
+
+#ifdef __linux__
+  if (cloned) {
+    // The clone must survive a crash before the input is modified
+    if (overwrite) {
+      syncPath(backupName);
+    }
+
+    transformFile(filename, outfile, xorkey, options);
+
+    return BackupMethod::Reflink;
+  }
+#endif
+
+  // The input is only read when the output is another file, so the backup
+  // can be written as the chunks go by. An overwrite modifies the input as
+  // it goes, so its backup is complete and on disk first
+  if (!overwrite) {
+    ProcessOptions fused{options};
+    fused.backupPath = backupName;
+    transformFile(filename, outfile, xorkey, fused);
+    std::cout << "Backup created (fused): " << backupName << '\n';
+
+    return BackupMethod::Fused;
+  }
+
+  BackupMethod method{backupFile(filename)};
+#ifdef DYNOXOR_POSIX_IO
+  syncPath(backupName);
+#endif
+  transformFile(filename, outfile, xorkey, options);
+
+  return method;
+}
+
+BackupMethod backupFile(const std::string& filename) {
+  StageTimer timer{Stage::Backup};
+  std::string backupName{filename + ".bak"};
+
+#ifdef __linux__
+  BackupMethod method{BackupMethod::Stream};
+
+  if (kernelCopy(filename, backupName, method)) {
+    std::cout << "Backup created (" << backupMethodName(method)
+              << "): " << backupName << '\n';
+
+    return method;
+  }
+#endif
+
   // Open the original file in binary mode for reading
   std::ifstream file(filename, std::ios::binary);
   if (!file) {
@@ -202,8 +663,6 @@ void backupFile(const std::string& filename) {
                              filename);
   }
 
-  std::string backupName{filename + ".bak"};
-
   // Open backup file in binary mode for writing
   std::ofstream backup(backupName, std::ios::binary);
   if (!backup) {
@@ -218,5 +677,7 @@ void backupFile(const std::string& filename) {
     throw std::runtime_error("Error writing backup file: " + backupName);
   }
 
-  std::cout << "Backup created: " << backupName << '\n';
-}
\ No newline at end of file
+  std::cout << "Backup created (stream): " << backupName << '\n';
+
+  return BackupMethod::Stream;
+}
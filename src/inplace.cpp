@@ -0,0 +1,267 @@
+#include "../include/inplace.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/fileio.hpp"
+#include "../include/stats.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+// Bytes mapped at once (a multiple of any page size in use)
+constexpr uint64_t windowSize{64ull * 1024 * 1024};
+// Smaller windows when journaling keep the undo record small
+constexpr uint64_t journaledWindowSize{4ull * 1024 * 1024};
+
+// Key bytes hashed into the journal fingerprint: a prefix, then evenly spaced
+// samples, so a pad the size of the data is not read in full up front
+constexpr size_t fingerprintPrefix{4096};
+constexpr size_t fingerprintSamples{64};
+constexpr size_t fingerprintSampleSize{64};
+
+// Smallest slice of a window worth handing to another thread
+constexpr uint64_t minimumSlice{1024 * 1024};
+
+constexpr char journalMagic[8]{'D', 'X', 'J', 'O', 'U', 'R', 'N', '1'};
+
+// Fixed-size record preceding the saved bytes in the journal file
+struct JournalHeader {
+  char magic[8];
+  uint64_t settings;
+  uint64_t offset;
+  uint64_t length;
+};
+
+// FNV-1a fingerprint of everything that determines the output bytes, so a
+// journal is never replayed with a different key or layout. Long keys are
+// identified by their length, prefix and a sample of the rest
+uint64_t settingsFingerprint(std::string_view xorkey,
+                             const ProcessOptions& options) {
+  uint64_t hash{14695981039346656037ull};
+  auto mix{[&hash](unsigned char byte) {
+    hash = (hash ^ byte) * 1099511628211ull;
+  }};
+  auto mixBytes{[&mix](std::string_view bytes) {
+    for (char c : bytes) {
+      mix(static_cast<unsigned char>(c));
+    }
+  }};
+
+  for (int shift{0}; shift < 64; shift += 8) {
+    mix(static_cast<unsigned char>(uint64_t{xorkey.size()} >> shift));
+  }
+
+  mixBytes(xorkey.substr(0, fingerprintPrefix));
+
+  if (xorkey.size() > fingerprintPrefix) {
+    const std::string_view rest{xorkey.substr(fingerprintPrefix)};
+    const size_t stride{std::max<size_t>(rest.size() / fingerprintSamples, 1)};
+
+    for (size_t at{0}; at < rest.size(); at += stride) {
+      mixBytes(rest.substr(at, fingerprintSampleSize));
+    }
+  }
+
+  mix(options.legacyKeyPhase ? 1 : 0);
+
+  if (options.legacyKeyPhase) {
+    for (int shift{0}; shift < 64; shift += 8) {
+      mix(static_cast<unsigned char>(uint64_t{options.chunkSize} >> shift));
+    }
+  }
+
+  return hash;
+}
+
+void syncFile(const FileHandle& file, const std::string& name) {
+  StageTimer timer{Stage::Sync};
+  countSyscall();
+
+  if (::fsync(file.get()) != 0) {
+    throw std::runtime_error("Failed to sync " + name);
+  }
+}
+
+// Atomically replace the journal with the original bytes of one window
+void writeJournal(const std::string& journalPath, const JournalHeader& header,
+                  const char* original) {
+  const std::string tempPath{journalPath + ".tmp"};
+  {
+    FileHandle journal{openOutputFile(tempPath)};
+    writeAt(journal, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+    writeAt(journal, original, header.length, sizeof(header));
+    syncFile(journal, tempPath);
+  }
+
+  {
+    StageTimer timer{Stage::Rename};
+    countSyscall();
+    std::filesystem::rename(tempPath, journalPath);
+  }
+
+  syncParentDirectory(journalPath);
+}
+
+// Restore the window recorded in a leftover journal and return its offset
+uint64_t recoverJournal(const FileHandle& file, const std::string& filename,
+                        const std::string& journalPath, uint64_t settings,
+                        uint64_t size) {
+  FileHandle journal{openInputFile(journalPath)};
+  JournalHeader header{};
+
+  if (readAt(journal, reinterpret_cast<char*>(&header), sizeof(header), 0) !=
+          sizeof(header) ||
+      std::memcmp(header.magic, journalMagic, sizeof(journalMagic)) != 0 ||
+      header.offset > size || header.length > size - header.offset) {
+    throw std::runtime_error("Corrupt in-place journal: " + journalPath);
+  }
+
+  if (header.settings != settings) {
+    throw std::runtime_error(
+        "In-place journal " + journalPath +
+        " was written with a different key; rerun with the original key to "
+        "resume.");
+  }
+
+  std::vector<char> original(header.length);
+
+  if (readAt(journal, original.data(), original.size(), sizeof(header)) !=
+      original.size()) {
+    throw std::runtime_error("Truncated in-place journal: " + journalPath);
+  }
+
+  writeAt(file, original.data(), original.size(), header.offset);
+  syncFile(file, filename);
+
+  std::cout << "Resuming interrupted in-place run of " << filename
+            << " at offset " << header.offset << '\n';
+
+  return header.offset;
+}
+
+// XOR a mapped window, split into page-aligned slices across options.threads
+void xorWindow(std::span<char> data, std::string_view xorkey, uint64_t offset,
+               const ProcessOptions& options) {
+  const uint64_t threadCount{std::clamp<uint64_t>(
+      options.threads, 1, std::max<uint64_t>(data.size() / minimumSlice, 1))};
+
+  if (threadCount == 1) {
+    xorWithLayout(data, xorkey, offset, options);
+    return;
+  }
+
+  const uint64_t slice{((data.size() + threadCount - 1) / threadCount + 4095) &
+                       ~uint64_t{4095}};
+  std::vector<std::thread> workers;
+
+  for (uint64_t begin{slice}; begin < data.size(); begin += slice) {
+    const size_t len{static_cast<size_t>(
+        std::min<uint64_t>(slice, data.size() - begin))};
+
+    workers.emplace_back([&, begin, len] {
+      xorWithLayout(data.subspan(begin, len), xorkey, offset + begin, options);
+    });
+  }
+
+  // The calling thread takes the first slice
+  xorWithLayout(data.first(static_cast<size_t>(slice)), xorkey, offset,
+                options);
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+}  // namespace
+
+void processFileInPlace(const std::string& filename, std::string_view xorkey,
+                        const ProcessOptions& options) {
+  FileHandle file{openReadWriteFile(filename)};
+  const uint64_t size{fileSize(file)};
+  const std::string journalPath{filename + ".journal"};
+  // Only runs that write or replay a journal need the fingerprint
+  const bool recovering{std::filesystem::exists(journalPath)};
+  const uint64_t settings{options.journal || recovering
+                              ? settingsFingerprint(xorkey, options)
+                              : 0};
+  const uint64_t window{options.journal ? journaledWindowSize : windowSize};
+  // The file is its own output: read-ahead, then writeback and release of
+  // each window once it is unmapped
+  const PageCachePolicy cache{file, file, size, false};
+  uint64_t offset{0};
+
+  // A leftover journal means a previous run stopped midway: undo its last
+  // window and continue from there
+  if (recovering) {
+    offset = recoverJournal(file, filename, journalPath, settings, size);
+  }
+
+  for (; offset < size; offset += window) {
+    const size_t len{static_cast<size_t>(std::min(window, size - offset))};
+
+    void* mapped{::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        file.get(), static_cast<off_t>(offset))};
+
+    if (mapped == MAP_FAILED) {
+      throw std::runtime_error("Failed to map " + filename + " for writing.");
+    }
+
+    ::madvise(mapped, len, MADV_SEQUENTIAL);
+    char* data{static_cast<char*>(mapped)};
+
+    try {
+      if (options.journal) {
+        JournalHeader header{};
+        std::memcpy(header.magic, journalMagic, sizeof(journalMagic));
+        header.settings = settings;
+        header.offset = offset;
+        header.length = len;
+        writeJournal(journalPath, header, data);
+      }
+
+      xorWindow(std::span<char>(data, len), xorkey, offset, options);
+
+      // The window must be on disk before the journal moves past it
+      if (options.journal) {
+        StageTimer timer{Stage::Sync};
+        countSyscall();
+
+        if (::msync(mapped, len, MS_SYNC) != 0) {
+          throw std::runtime_error("Failed to sync " + filename);
+        }
+      }
+    } catch (...) {
+      ::munmap(mapped, len);
+      throw;
+    }
+
+    ::munmap(mapped, len);
+    cache.release(offset, len, 0, size);
+  }
+
+  if (std::filesystem::exists(journalPath)) {
+    std::filesystem::remove(journalPath);
+    syncParentDirectory(journalPath);
+  }
+}
+
+#else
+
+void processFileInPlace(const std::string&, std::string_view,
+                        const ProcessOptions&) {
+  throw std::runtime_error("In-place processing requires memory mapping.");
+}
+
+#endif
@@ -0,0 +1,435 @@
+#include "../include/kernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DYNOXOR_X86_DISPATCH 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Keys shorter than this are expanded into a repeating block; longer keys are
+// already long enough to be XORed straight from their own bytes
+constexpr size_t expandLimit{4096};
+// Expanded blocks are at least this long and a multiple of every vector width
+constexpr size_t blockMinimum{4096};
+constexpr size_t blockAlignment{64};
+
+// Length of the expanded block of a key: a multiple of both the key length
+// and the widest vector, so the key stream for any run of data is contiguous
+// from a rotating start offset
+size_t blockLength(size_t keyLen) {
+  const size_t period{std::lcm(keyLen, blockAlignment)};
+
+  return period * ((blockMinimum + period - 1) / period);
+}
+
+// The key repeated over a cache-aligned block of blockLength bytes
+class ExpandedKey {
+ public:
+  std::string_view block(std::string_view key) {
+    if (key != key_) {
+      expand(key);
+    }
+
+    return {data_, period_};
+  }
+
+ private:
+  void expand(std::string_view key) {
+    key_.assign(key);
+    period_ = blockLength(key.size());
+
+    storage_.resize(period_ + blockAlignment);
+    const size_t misalignment{reinterpret_cast<uintptr_t>(storage_.data()) %
+                              blockAlignment};
+    data_ = storage_.data() +
+            (misalignment ? blockAlignment - misalignment : 0);
+
+    for (size_t i{0}; i < period_; ++i) {
+      data_[i] = key[i % key.size()];
+    }
+  }
+
+  std::string key_;
+  std::vector<char> storage_;
+  char* data_{nullptr};
+  size_t period_{0};
+};
+
+// Each thread keeps the block of the last key it used, so chunks and files
+// sharing a key expand it only once
+std::string_view expandedKey(std::string_view key) {
+  thread_local ExpandedKey cache;
+
+  return cache.block(key);
+}
+
+// Portable byte-at-a-time kernel, also used for the tails of vector kernels
+void xorScalar(char* data, const char* key, size_t len) {
+  for (size_t i{0}; i < len; ++i) {
+    data[i] ^= key[i];
+  }
+}
+
+// Key lengths with kernels specialized at compile time; each divides the
+// rotated key stream handed to them, which is fixedStream bytes long
+constexpr size_t fixedKeyLengths[]{16, 32, 64};
+constexpr size_t fixedStream{64};
+
+template <size_t KeyLen>
+void xorScalarFixed(char* data, const char* key, size_t len) {
+  for (size_t i{0}; i < len; ++i) {
+    data[i] ^= key[i % KeyLen];
+  }
+}
+
+#ifdef DYNOXOR_X86_DISPATCH
+
+// The fixed-length kernels keep the whole key in registers: one vector per
+// width bytes of key, or a single vector when the key repeats inside it
+
+template <size_t KeyLen>
+__attribute__((target("sse2"))) void xorSse2Fixed(char* data, const char* key,
+                                                   size_t len) {
+  constexpr size_t width{16};
+  constexpr size_t regs{std::max(KeyLen, width) / width};
+  __m128i k[regs];
+  size_t i{0};
+
+  for (size_t r{0}; r < regs; ++r) {
+    k[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + r * width));
+  }
+
+  for (; i + regs * width <= len; i += regs * width) {
+    for (size_t r{0}; r < regs; ++r) {
+      char* p{data + i + r * width};
+      __m128i d{_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))};
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_xor_si128(d, k[r]));
+    }
+  }
+
+  xorScalar(data + i, key, len - i);
+}
+
+template <size_t KeyLen>
+__attribute__((target("avx2"))) void xorAvx2Fixed(char* data, const char* key,
+                                                   size_t len) {
+  constexpr size_t width{32};
+  constexpr size_t regs{std::max(KeyLen, width) / width};
+  __m256i k[regs];
+  size_t i{0};
+
+  for (size_t r{0}; r < regs; ++r) {
+    k[r] =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + r * width));
+  }
+
+  for (; i + regs * width <= len; i += regs * width) {
+    for (size_t r{0}; r < regs; ++r) {
+      char* p{data + i + r * width};
+      __m256i d{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))};
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p),
+                          _mm256_xor_si256(d, k[r]));
+    }
+  }
+
+  xorScalar(data + i, key, len - i);
+}
+
+template <size_t KeyLen>
+__attribute__((target("avx512f"))) void xorAvx512Fixed(char* data,
+                                                       const char* key,
+                                                       size_t len) {
+  constexpr size_t width{64};
+  const __m512i k{_mm512_loadu_si512(key)};
+  size_t i{0};
+
+  static_assert(KeyLen <= width);
+
+  for (; i + width <= len; i += width) {
+    __m512i d{_mm512_loadu_si512(data + i)};
+    _mm512_storeu_si512(data + i, _mm512_xor_si512(d, k));
+  }
+
+  xorScalar(data + i, key, len - i);
+}
+
+__attribute__((target("sse2"))) void xorSse2(char* data, const char* key,
+                                              size_t len) {
+  constexpr size_t width{16};
+  size_t i{0};
+
+  for (; i + width <= len; i += width) {
+    __m128i d{_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))};
+    __m128i k{_mm_loadu_si128(reinterpret_cast<const __m128i*>(key + i))};
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_xor_si128(d, k));
+  }
+
+  xorScalar(data + i, key + i, len - i);
+}
+
+__attribute__((target("avx2"))) void xorAvx2(char* data, const char* key,
+                                              size_t len) {
+  constexpr size_t width{32};
+  size_t i{0};
+
+  for (; i + width <= len; i += width) {
+    __m256i d{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))};
+    __m256i k{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(key + i))};
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i),
+                        _mm256_xor_si256(d, k));
+  }
+
+  xorScalar(data + i, key + i, len - i);
+}
+
+__attribute__((target("avx512f"))) void xorAvx512(char* data, const char* key,
+                                                   size_t len) {
+  constexpr size_t width{64};
+  size_t i{0};
+
+  for (; i + width <= len; i += width) {
+    __m512i d{_mm512_loadu_si512(data + i)};
+    __m512i k{_mm512_loadu_si512(key + i)};
+    _mm512_storeu_si512(data + i, _mm512_xor_si512(d, k));
+  }
+
+  xorScalar(data + i, key + i, len - i);
+}
+
+// Read the XCR0 register to check which vector states the OS saves
+unsigned long long readXcr0() {
+  unsigned int eax{0};
+  unsigned int edx{0};
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+  return (static_cast<unsigned long long>(edx) << 32) | eax;
+}
+
+bool cpuHasSse2() {
+  unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2);
+}
+
+bool cpuHasAvx2() {
+  unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+
+  // AVX state must be enabled by the OS (OSXSAVE + XMM/YMM in XCR0)
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) ||
+      (readXcr0() & 0x6) != 0x6) {
+    return false;
+  }
+
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+
+bool cpuHasAvx512() {
+  unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+
+  // Opmask and ZMM states must be enabled in addition to AVX
+  if (!cpuHasAvx2() || (readXcr0() & 0xe6) != 0xe6) {
+    return false;
+  }
+
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+         (ebx & bit_AVX512F);
+}
+
+#endif
+
+bool alwaysSupported() {
+  return true;
+}
+
+struct XorKernel {
+  const char* name;
+  XorKernelFn fn;
+  // Specializations for each of fixedKeyLengths, in the same order
+  XorKernelFn fixed[std::size(fixedKeyLengths)];
+  bool (*supported)();
+};
+
+// Known kernels, ordered from slowest to fastest
+const XorKernel kernels[]{
+    {"scalar",
+     xorScalar,
+     {xorScalarFixed<16>, xorScalarFixed<32>, xorScalarFixed<64>},
+     alwaysSupported},
+#ifdef DYNOXOR_X86_DISPATCH
+    {"sse2",
+     xorSse2,
+     {xorSse2Fixed<16>, xorSse2Fixed<32>, xorSse2Fixed<64>},
+     cpuHasSse2},
+    {"avx2",
+     xorAvx2,
+     {xorAvx2Fixed<16>, xorAvx2Fixed<32>, xorAvx2Fixed<64>},
+     cpuHasAvx2},
+    {"avx512",
+     xorAvx512,
+     {xorAvx512Fixed<16>, xorAvx512Fixed<32>, xorAvx512Fixed<64>},
+     cpuHasAvx512},
+#endif
+};
+
+// Specialized kernel for a key length, or nullptr to take the general path
+XorKernelFn fixedKernel(const XorKernel& kernel, size_t keyLen) {
+  for (size_t i{0}; i < std::size(fixedKeyLengths); ++i) {
+    if (keyLen == fixedKeyLengths[i]) {
+      return kernel.fixed[i];
+    }
+  }
+
+  return nullptr;
+}
+
+const XorKernel* bestKernel() {
+  const XorKernel* best{&kernels[0]};
+
+  for (const XorKernel& kernel : kernels) {
+    if (kernel.supported()) {
+      best = &kernel;
+    }
+  }
+
+  return best;
+}
+
+// Kernel used by xorBuffer, resolved through CPUID on first use
+std::atomic<const XorKernel*>& activeKernel() {
+  static std::atomic<const XorKernel*> active{bestKernel()};
+
+  return active;
+}
+
+// Keys XORed through a specialized kernel or straight from their own bytes
+bool needsBlock(size_t keyLen) {
+  return keyLen < expandLimit &&
+         std::find(std::begin(fixedKeyLengths), std::end(fixedKeyLengths),
+                   keyLen) == std::end(fixedKeyLengths);
+}
+
+// xorBuffer once the key block is known (block is unused for fixed lengths)
+void xorWithBlock(char* data, size_t len, std::string_view xorkey,
+                  std::string_view block, size_t keyIndex) {
+  const XorKernel& kernel{*activeKernel().load(std::memory_order_relaxed)};
+  size_t phase{keyIndex % xorkey.size()};
+
+  if (const XorKernelFn fixed{fixedKernel(kernel, xorkey.size())}) {
+    // Rotate the key once so the kernel can hold it in registers
+    alignas(64) char stream[fixedStream];
+
+    for (size_t i{0}; i < fixedStream; ++i) {
+      stream[i] = xorkey[(phase + i) % xorkey.size()];
+    }
+
+    fixed(data, stream, len);
+    return;
+  }
+
+  // XOR the data against the key block, wrapping to its start as needed
+  while (len) {
+    const size_t run{std::min(len, block.size() - phase)};
+    kernel.fn(data, block.data() + phase, run);
+
+    data += run;
+    len -= run;
+    phase = 0;
+  }
+}
+
+}  // namespace
+
+void xorBuffer(char* data, size_t len, std::string_view xorkey,
+               size_t keyIndex) {
+  if (xorkey.empty() || !len) {
+    return;
+  }
+
+  xorWithBlock(data, len, xorkey,
+               needsBlock(xorkey.size()) ? expandedKey(xorkey) : xorkey,
+               keyIndex);
+}
+
+std::string expandKey(std::string_view xorkey) {
+  if (!needsBlock(xorkey.size())) {
+    return {};
+  }
+
+  std::string block(blockLength(xorkey.size()), '\0');
+
+  for (size_t i{0}; i < block.size(); ++i) {
+    block[i] = xorkey[i % xorkey.size()];
+  }
+
+  return block;
+}
+
+void xorBufferExpanded(char* data, size_t len, std::string_view xorkey,
+                       std::string_view block, size_t keyIndex) {
+  if (xorkey.empty() || !len) {
+    return;
+  }
+
+  xorWithBlock(data, len, xorkey, block.empty() ? xorkey : block, keyIndex);
+}
+
+void xorRange(std::span<char> data, std::string_view xorkey,
+              uint64_t keyOffset) {
+  if (xorkey.empty()) {
+    return;
+  }
+
+  // Reduce in 64 bits so offsets past 4 GiB stay exact on 32-bit targets
+  xorBuffer(data.data(), data.size(), xorkey,
+            static_cast<size_t>(keyOffset % xorkey.size()));
+}
+
+std::string xorKernelName() {
+  return activeKernel().load()->name;
+}
+
+std::vector<std::string> availableXorKernels() {
+  std::vector<std::string> names;
+
+  for (const XorKernel& kernel : kernels) {
+    if (kernel.supported()) {
+      names.emplace_back(kernel.name);
+    }
+  }
+
+  return names;
+}
+
+void selectXorKernel(const std::string& name) {
+  if (name == "auto") {
+    activeKernel().store(bestKernel());
+    return;
+  }
+
+  for (const XorKernel& kernel : kernels) {
+    if (name == kernel.name) {
+      if (!kernel.supported()) {
+        throw std::runtime_error("XOR kernel not supported by this CPU: " +
+                                 name);
+      }
+
+      activeKernel().store(&kernel);
+      return;
+    }
+  }
+
+  throw std::runtime_error("Unknown XOR kernel: " + name);
+}
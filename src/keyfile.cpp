@@ -0,0 +1,85 @@
+#include "../include/keyfile.hpp"
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include "../include/constants.hpp"
+#include "../include/fileio.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+void checkKeySize(uint64_t size, const std::string& path) {
+  if (size < Constants::minimumKeySize) {
+    throw std::runtime_error("Key file " + path +
+                             " is too short, it must hold at least " +
+                             std::to_string(Constants::minimumKeySize) +
+                             " bytes (random if possible).");
+  }
+
+  if (size > std::numeric_limits<size_t>::max()) {
+    throw std::runtime_error("Key file " + path +
+                             " is too large to map on this platform.");
+  }
+}
+
+}  // namespace
+
+#ifdef DYNOXOR_POSIX_IO
+
+KeyFile::KeyFile(const std::string& path) {
+  // The mapping stays valid once the descriptor is closed
+  FileHandle file{openInputFile(path)};
+  const uint64_t size{fileSize(file)};
+  checkKeySize(size, path);
+
+  void* mapped{::mmap(nullptr, static_cast<size_t>(size), PROT_READ,
+                      MAP_PRIVATE, file.get(), 0)};
+
+  if (mapped == MAP_FAILED) {
+    throw std::runtime_error("Failed to map key file " + path);
+  }
+
+  // Key bytes are consumed in step with the input, front to back: read
+  // ahead aggressively and let pages behind go
+  ::madvise(mapped, static_cast<size_t>(size), MADV_SEQUENTIAL);
+
+  data_ = static_cast<const char*>(mapped);
+  size_ = static_cast<size_t>(size);
+  mapped_ = true;
+}
+
+KeyFile::~KeyFile() {
+  if (mapped_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+#else
+
+KeyFile::KeyFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file) {
+    throw std::runtime_error("Failed to open key file " + path);
+  }
+
+  contents_.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+
+  if (file.bad()) {
+    throw std::runtime_error("Failed to read key file " + path);
+  }
+
+  checkKeySize(contents_.size(), path);
+  data_ = contents_.data();
+  size_ = contents_.size();
+}
+
+KeyFile::~KeyFile() = default;
+
+#endif
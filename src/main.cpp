@@ -1,9 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <filesystem>
+#include <fstream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "../include/CLI11.hpp"
+#include "../include/backends.hpp"
+#include "../include/batch.hpp"
+#include "../include/buffers.hpp"
 #include "../include/constants.hpp"
 #include "../include/functions.hpp"
+#include "../include/kernels.hpp"
+#include "../include/keyfile.hpp"
+#include "../include/perfcounters.hpp"
+#include "../include/profile.hpp"
+#include "../include/stats.hpp"
+#include "../include/streaming.hpp"
+#include "../include/tuning.hpp"
+
+// Measure the device holding a file and store its tuning profile
+int calibrateProfile(const std::vector<std::string>& inputs) {
+  if (inputs.size() != 1 || isStandardStream(inputs.front()) ||
+      std::filesystem::is_directory(inputs.front())) {
+    throw std::runtime_error(
+        "--calibrate needs a single regular file on the device to tune.");
+  }
+
+  verifyFile(inputs.front());
+
+  std::cout << "Calibrating with " << inputs.front() << "...\n";
+  TuningProfile profile{calibrateDevice(inputs.front())};
+  saveProfile(defaultProfilePath(), profile);
+  std::cout << "Saved tuning profile: " << formatProfile(profile) << '\n';
+
+  return 0;
+}
+
+// Each run uses one engine, so refuse engine options that would otherwise be
+// silently overridden by another one given on the command line
+void checkEngineOptions(bool threads, bool ioBackend,
+                        const std::string& backend, bool pipeline,
+                        bool direct) {
+  if (threads && (ioBackend || pipeline)) {
+    throw std::runtime_error(
+        "--threads runs its own positioned-I/O workers and cannot be combined "
+        "with --io-backend or --pipeline.");
+  }
+
+  if (pipeline && ioBackend) {
+    throw std::runtime_error(
+        "--pipeline has its own reader and writer threads and cannot be "
+        "combined with --io-backend.");
+  }
+
+  if (direct && (pipeline || backend == "uring")) {
+    throw std::runtime_error(
+        "--direct uses the posix backend and cannot be combined with "
+        "--pipeline or --io-backend uring.");
+  }
+}
+
+// Print the --stats report and write it as JSON if a path is given, then
+// the --perf-counters report
+void reportStats(std::chrono::steady_clock::time_point start, bool print,
+                 const std::string& jsonPath) {
+  if (perfCountersEnabled()) {
+    std::cout << formatPerfCounters(collectPerfCounters());
+  }
+
+  if (!statsEnabled()) {
+    return;
+  }
+
+  const RunStats stats{collectStats(std::chrono::duration<double>(
+                                        std::chrono::steady_clock::now() -
+                                        start)
+                                        .count())};
+
+  if (print) {
+    std::cout << "Statistics:\n" << formatStats(stats);
+  }
+
+  if (!jsonPath.empty()) {
+    std::ofstream json(jsonPath);
+    json << formatStatsJson(stats);
+
+    if (!json) {
+      throw std::runtime_error("Unable to write statistics: " + jsonPath);
+    }
+  }
+}
+
+// Key files are meant as pads as long as the data: a shorter one repeats,
+// which the XOR output gives away, so say so
+void warnShortKeyFile(const std::optional<KeyFile>& keyFile,
+                      uint64_t dataEnd) {
+  if (keyFile && keyFile->key().size() < dataEnd) {
+    std::cerr << "Warning: the key file (" << keyFile->key().size()
+              << " bytes) is shorter than the data (" << dataEnd
+              << " bytes) and will be repeated; it is not a one-time pad.\n";
+  }
+}
+
+// Process several files at once; per-file errors are reported at the end
+int processBatch(const std::vector<std::string>& inputs, std::string& outfile,
+                 std::string& xorkey, const std::optional<KeyFile>& keyFile,
+                 bool generate, bool overwrite, bool printKernel,
+                 const ProcessOptions& options, const BatchOptions& batch,
+                 bool printStats, const std::string& statsJson) {
+  for (const std::string& input : inputs) {
+    if (isStandardStream(input) || isStandardStream(outfile)) {
+      throw std::runtime_error(
+          "Standard streams cannot be used with several input files.");
+    }
+  }
+
+  if (!keyFile) {
+    verifyKey(xorkey, generate);
+  }
+
+  // Without -o every input is overwritten; -o names an output directory
+  if (outfile.empty()) {
+    std::string label{"the input files"};
+    verifyOutfile(outfile, label, overwrite);
+    outfile.clear();
+  }
+
+  std::vector<BatchJob> jobs{collectBatchJobs(inputs, outfile)};
+
+  // Largest first, so the first job needs the longest key
+  if (!jobs.empty()) {
+    warnShortKeyFile(keyFile, jobs.front().size);
+  }
+
+  if (printKernel) {
+    std::cout << "XOR kernel: " << xorKernelName() << '\n';
+  }
+
+  if (generate) {
+    generateKey(xorkey);
+  }
+
+  const std::string_view key{keyFile ? keyFile->key() : xorkey};
+  const auto start{std::chrono::steady_clock::now()};
+  std::vector<BatchFailure> failures{runBatch(jobs, key, options, batch)};
+
+  std::cout << "Processed " << jobs.size() - failures.size() << " of "
+            << jobs.size() << " files.\n";
+
+  for (const BatchFailure& failure : failures) {
+    std::cerr << "Error processing " << failure.input << ": " << failure.error
+              << '\n';
+  }
+
+  if (statsEnabled() || perfCountersEnabled()) {
+    reportStats(start, printStats, statsJson);
+  }
+
+  return failures.empty() ? 0 : 1;
+}
 
 int main(int argc, char* argv[]) {
 
@@ -13,24 +173,50 @@ int main(int argc, char* argv[]) {
                  "\nA Simple XOR Encryption TOOL by @Tuuxy."};
 
     // Variables for CLI options
-    std::string filename;
+    std::vector<std::string> filenames;
+    std::string fileList;
     std::string xorkey;
+    std::string keyFilePath;
     std::string outfile;
+    std::string kernel{"auto"};
+    std::string ioBackend{"stream"};
+    std::string hugePages{"off"};
+    std::string chunkSize;
+    std::string statsJson;
 
     bool overwrite{false};
     bool backup{false};
     bool generate{false};
     bool keyLog{false};
+    bool printKernel{false};
+    bool calibrate{false};
+    bool noProfile{false};
+    bool printStats{false};
+    bool perfCounters{false};
+    uint64_t rangeOffset{0};
+    uint64_t rangeLength{UINT64_MAX};
+    ProcessOptions options{};
+    BatchOptions batch{.jobs = std::max(std::thread::hardware_concurrency(), 1u)};
 
     // Define CLI options and flags with descriptions, required flags set appropriately
     app.add_option(Constants::keyFlag, xorkey, Constants::keyFlagDescription)
         ->required(false);
+    app.add_option(Constants::keyFileFlag, keyFilePath,
+                   Constants::keyFileFlagDescription)
+        ->required(false);
     app.add_flag(Constants::generateFlag, generate,
                  Constants::generateFlagDescription)
         ->required(false);
-    app.add_option(Constants::fileFlag, filename,
+    app.add_option(Constants::fileFlag, filenames,
                    Constants::fileFlagDescription)
-        ->required(true);
+        ->required(false);
+    app.add_option(Constants::fileListFlag, fileList,
+                   Constants::fileListFlagDescription)
+        ->required(false);
+    app.add_option(Constants::jobsFlag, batch.jobs,
+                   Constants::jobsFlagDescription)
+        ->check(CLI::PositiveNumber)
+        ->required(false);
     app.add_option(Constants::outFlag, outfile, Constants::outFlagDescription)
         ->required(false);
     app.add_flag(Constants::overwriteFlag, overwrite,
@@ -41,6 +227,71 @@ int main(int argc, char* argv[]) {
         ->required(false);
     app.add_flag(Constants::logFlag, keyLog, Constants::logFlagDescription)
         ->required(false);
+    CLI::Option* kernelOption{app.add_option(Constants::kernelFlag, kernel,
+                                             Constants::kernelFlagDescription)
+                                  ->required(false)};
+    app.add_flag(Constants::printKernelFlag, printKernel,
+                 Constants::printKernelFlagDescription)
+        ->required(false);
+    app.add_flag(Constants::legacyKeyPhaseFlag, options.legacyKeyPhase,
+                 Constants::legacyKeyPhaseFlagDescription)
+        ->required(false);
+    CLI::Option* threadsOption{
+        app.add_option(Constants::threadsFlag, options.threads,
+                       Constants::threadsFlagDescription)
+            ->check(CLI::PositiveNumber)
+            ->required(false)};
+    app.add_flag(Constants::journalFlag, options.journal,
+                 Constants::journalFlagDescription)
+        ->required(false);
+    CLI::Option* ioBackendOption{
+        app.add_option(Constants::ioBackendFlag, ioBackend,
+                       Constants::ioBackendFlagDescription)
+            ->check(CLI::IsMember({"stream", "posix", "uring"}))
+            ->required(false)};
+    app.add_option(Constants::queueDepthFlag, options.queueDepth,
+                   Constants::queueDepthFlagDescription)
+        ->check(CLI::Range(1, 4096))
+        ->required(false);
+    CLI::Option* pipelineOption{
+        app.add_option(Constants::pipelineFlag, options.pipelineWorkers,
+                       Constants::pipelineFlagDescription)
+            ->check(CLI::PositiveNumber)
+            ->required(false)};
+    CLI::Option* chunkSizeOption{
+        app.add_option(Constants::chunkSizeFlag, chunkSize,
+                       Constants::chunkSizeFlagDescription)
+            ->required(false)};
+    app.add_flag(Constants::directFlag, options.direct,
+                 Constants::directFlagDescription)
+        ->required(false);
+    app.add_option(Constants::hugePagesFlag, hugePages,
+                   Constants::hugePagesFlagDescription)
+        ->check(CLI::IsMember({"off", "transparent", "explicit"}))
+        ->required(false);
+    app.add_flag(Constants::calibrateFlag, calibrate,
+                 Constants::calibrateFlagDescription)
+        ->required(false);
+    app.add_flag(Constants::noProfileFlag, noProfile,
+                 Constants::noProfileFlagDescription)
+        ->required(false);
+    app.add_flag(Constants::statsFlag, printStats,
+                 Constants::statsFlagDescription)
+        ->required(false);
+    app.add_option(Constants::statsJsonFlag, statsJson,
+                   Constants::statsJsonFlagDescription)
+        ->required(false);
+    app.add_flag(Constants::perfCountersFlag, perfCounters,
+                 Constants::perfCountersFlagDescription)
+        ->required(false);
+    CLI::Option* offsetOption{app.add_option(Constants::offsetFlag,
+                                             rangeOffset,
+                                             Constants::offsetFlagDescription)
+                                  ->required(false)};
+    CLI::Option* lengthOption{app.add_option(Constants::lengthFlag,
+                                             rangeLength,
+                                             Constants::lengthFlagDescription)
+                                  ->required(false)};
 
     try {
       app.parse(argc, argv);
@@ -48,10 +299,165 @@ int main(int argc, char* argv[]) {
       return app.exit(e);
     }
 
+    if (!fileList.empty()) {
+      for (const std::string& path : readFileList(fileList)) {
+        filenames.push_back(path);
+      }
+    }
+
+    if (filenames.empty()) {
+      throw std::runtime_error("you must specify --file or --file-list.");
+    }
+
+    if (calibrate) {
+      return calibrateProfile(filenames);
+    }
+
+    checkEngineOptions(threadsOption->count() && options.threads > 1,
+                       ioBackendOption->count() > 0, ioBackend,
+                       pipelineOption->count() > 0, options.direct);
+
+    // Settings measured by --calibrate for the (first) input's device fill in
+    // the options not given on the command line
+    const std::string volume{isStandardStream(filenames.front())
+                                 ? ""
+                                 : probeStorage(filenames.front()).volume};
+
+    std::optional<TuningProfile> profile;
+
+    if (!noProfile && !volume.empty()) {
+      profile = loadProfile(defaultProfilePath(), volume);
+    }
+
+    if (profile) {
+      const std::vector<std::string> kernels{availableXorKernels()};
+
+      // A profile shared through a network home may come from another CPU
+      if (!kernelOption->count() &&
+          std::find(kernels.begin(), kernels.end(), profile->kernel) !=
+              kernels.end()) {
+        kernel = profile->kernel;
+      }
+
+      // Profile threads would override an engine chosen on the command line
+      if (!threadsOption->count() && !pipelineOption->count() &&
+          !ioBackendOption->count()) {
+        options.threads = profile->threads;
+      }
+
+      if (!ioBackendOption->count()) {
+        ioBackend = ioBackendName(profile->ioBackend);
+      }
+
+      // The legacy layout depends on the chunk size, so keep it as given
+      if (!chunkSizeOption->count() && !options.legacyKeyPhase) {
+        options.chunkSize = profile->chunkSize;
+      }
+    }
+
+    selectXorKernel(kernel);
+    options.ioBackend = parseIoBackend(ioBackend);
+    setHugePages(parseHugePages(hugePages));
+    enableStats(printStats || !statsJson.empty());
+    enablePerfCounters(perfCounters);
+
+    if (!chunkSize.empty()) {
+      options.chunkSize = parseChunkSize(chunkSize);
+    }
+
+    // 0 stands for auto; the size is then picked for each input file
+    const bool autoChunk{options.chunkSize == 0};
+
+    if (autoChunk && options.legacyKeyPhase) {
+      throw std::runtime_error(
+          "--chunk-size auto cannot be used with --legacy-key-phase, whose "
+          "output depends on the chunk size.");
+    }
+
+    const bool range{offsetOption->count() || lengthOption->count()};
+
+    // A key file stands in for --key and --generate, and is mapped once for
+    // every input
+    std::optional<KeyFile> keyFile;
+
+    if (!keyFilePath.empty()) {
+      if (!xorkey.empty() || generate) {
+        throw std::runtime_error(
+            "--key-file cannot be used with --key or --generate.");
+      }
+
+      if (keyLog) {
+        throw std::runtime_error(
+            "--log cannot be used with --key-file; keep the key file instead.");
+      }
+
+      keyFile.emplace(keyFilePath);
+    }
+
+    // Several inputs or a directory: process them all on a worker pool
+    if (filenames.size() > 1 || !fileList.empty() ||
+        std::filesystem::is_directory(filenames.front())) {
+      if (range) {
+        throw std::runtime_error(
+            "--offset and --length apply to a single input file.");
+      }
+
+      batch.backup = backup;
+      batch.keyLog = keyLog;
+      batch.autoChunkSize = autoChunk;
+
+      return processBatch(filenames, outfile, xorkey, keyFile, generate,
+                          overwrite, printKernel, options, batch, printStats,
+                          statsJson);
+    }
+
+    std::string filename{filenames.front()};
+
     verifyFile(filename);
-    verifyKey(xorkey, generate);
+
+    if (!keyFile) {
+      verifyKey(xorkey, generate);
+    }
+
+    // A range is a lookup: it never replaces the input, and goes to standard
+    // output unless an output file is named
+    if (range) {
+      if (backup) {
+        throw std::runtime_error(
+            "--backup cannot be used with --offset or --length, which leave "
+            "the input untouched.");
+      }
+
+      if (outfile.empty()) {
+        outfile = Constants::streamPath;
+      }
+    }
+
+    // Standard input cannot be overwritten, so it streams to standard output
+    if (isStandardStream(filename) && outfile.empty()) {
+      outfile = Constants::streamPath;
+    }
+
     verifyOutfile(outfile, filename, overwrite);
 
+    if (isStandardStream(filename) && backup) {
+      throw std::runtime_error("Cannot back up standard input.");
+    }
+
+    // Keep standard output clean for the data; messages go to stderr
+    if (isStandardStream(outfile)) {
+      std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    if (printKernel) {
+      std::cout << "XOR kernel: " << xorKernelName() << '\n';
+    }
+
+    if (autoChunk) {
+      options.chunkSize = autoChunkSize(filename);
+      std::cout << "Chunk size: " << options.chunkSize << " bytes (auto)\n";
+    }
+
     if (generate) {
       generateKey(xorkey);
     }
@@ -60,39 +466,41 @@ int main(int argc, char* argv[]) {
       logKey(xorkey, filename);
     }
 
-    if (backup) {
-      backupFile(filename);
-    }
-
-    // Process the file: if output path equals input, use a temp file and rename to avoid data loss
-    if (filename == outfile) {
-      std::string tempFileName{filename + ".tmp"};
-      try {
-        processFileInChunks(filename, tempFileName, xorkey);
-      } catch (const std::exception& e) {
-        std::cerr << "Error during processing: " << e.what() << '\n';
+    // Bytes are keyed on their offset in the file, so a range needs the key
+    // up to its end. The length of standard input is not known up front
+    if (keyFile && !isStandardStream(filename)) {
+      uint64_t dataEnd{std::filesystem::file_size(filename)};
 
-        return 1;
+      if (range) {
+        dataEnd = rangeOffset < dataEnd
+                      ? rangeOffset +
+                            std::min(rangeLength, dataEnd - rangeOffset)
+                      : 0;
       }
 
-      try {
-        std::filesystem::rename(tempFileName, outfile);
-      } catch (const std::filesystem::filesystem_error& e) {
+      warnShortKeyFile(keyFile, dataEnd);
+    }
 
-        std::cerr << "Error renaming temporary file: " << e.what() << '\n';
-        std::cerr << "Temporary file left as: " << tempFileName << '\n';
+    const std::string_view key{keyFile ? keyFile->key() : xorkey};
+    const auto start{std::chrono::steady_clock::now()};
 
-        return 1;
+    try {
+      if (range) {
+        transformRange(filename, outfile, key, rangeOffset, rangeLength,
+                       options);
+      } else if (backup) {
+        transformFileWithBackup(filename, outfile, key, options);
+      } else {
+        transformFile(filename, outfile, key, options);
       }
+    } catch (const std::exception& e) {
+      std::cerr << "Error during processing: " << e.what() << '\n';
 
-    } else {
-      try {
-        processFileInChunks(filename, outfile, xorkey);
-      } catch (const std::exception& e) {
+      return 1;
+    }
 
-        std::cerr << "Error during processing: " << e.what() << '\n';
-        return 1;
-      }
+    if (statsEnabled() || perfCountersEnabled()) {
+      reportStats(start, printStats, statsJson);
     }
 
   } catch (const std::exception& e) {
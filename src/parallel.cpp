@@ -0,0 +1,91 @@
+#include "../include/parallel.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/buffers.hpp"
+#include "../include/fileio.hpp"
+#include "../include/stats.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+
+void processFileParallel(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options) {
+  FileHandle input{openInputFile(filename)};
+  FileHandle output{openOutputFile(outfile)};
+  FileHandle backup{openBackupFile(options.backupPath)};
+  const uint64_t size{fileSize(input)};
+  // Also sizes the output up front so every thread writes inside the file
+  const PageCachePolicy cache{input, output, size, options.direct};
+  const uint64_t chunkSize{
+      std::max<uint64_t>(cache.chunkSize(options.chunkSize), 1)};
+
+  // Split the file into one chunk-aligned range per thread
+  const uint64_t chunks{(size + chunkSize - 1) / chunkSize};
+  const uint64_t threadCount{
+      std::clamp<uint64_t>(options.threads, 1, std::max<uint64_t>(chunks, 1))};
+  const uint64_t chunksPerThread{(chunks + threadCount - 1) / threadCount};
+
+  std::vector<std::exception_ptr> errors(threadCount);
+  std::vector<std::thread> workers;
+
+  for (uint64_t t{0}; t < threadCount; ++t) {
+    const uint64_t begin{std::min(size, t * chunksPerThread * chunkSize)};
+    const uint64_t end{std::min(size, (t + 1) * chunksPerThread * chunkSize)};
+
+    workers.emplace_back([&, t, begin, end] {
+      try {
+        IoBuffer buffer{acquireBuffer(chunkSize)};
+
+        for (uint64_t offset{begin}; offset < end; offset += chunkSize) {
+          const size_t len{static_cast<size_t>(std::min(chunkSize, end - offset))};
+          const size_t bytesRead{readAt(input, buffer.data(),
+                                        cache.transferSize(len), offset)};
+
+          if (bytesRead < len) {
+            throw std::runtime_error("Input file shrank while processing.");
+          }
+
+          if (backup) {
+            StageTimer timer{Stage::Backup};
+            writeAt(backup, buffer.data(), len, offset);
+          }
+
+          xorWithLayout(std::span<char>(buffer.data(), len), xorkey, offset,
+                        options);
+          writeAt(output, buffer.data(), cache.transferSize(len), offset);
+          cache.release(offset, len, begin, end);
+        }
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    });
+  }
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  cache.finish(size);
+}
+
+#else
+
+void processFileParallel(const std::string&, const std::string&,
+                         std::string_view, const ProcessOptions&) {
+  throw std::runtime_error(
+      "Multi-threaded processing requires positioned I/O (pread/pwrite).");
+}
+
+#endif
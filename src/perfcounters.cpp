@@ -0,0 +1,252 @@
+#include "../include/perfcounters.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+std::atomic<bool> enabled{false};
+// Totals of exited threads and the first reason a thread had no counters
+std::mutex totalsMutex;
+PerfCounts totals;
+
+std::string decimal(double value) {
+  char text[64];
+  std::snprintf(text, sizeof(text), "%.3f", value);
+
+  return text;
+}
+
+#ifdef __linux__
+
+constexpr size_t eventCount{4};
+constexpr uint64_t eventConfigs[eventCount]{
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+std::string openFailureReason(int error) {
+  if (error == EACCES || error == EPERM) {
+    std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+    std::string level{"unknown"};
+    paranoid >> level;
+
+    return "access denied (perf_event_paranoid=" + level +
+           "; lower it or grant CAP_PERFMON)";
+  }
+
+  if (error == ENOENT || error == EOPNOTSUPP || error == ENODEV) {
+    return "no hardware counters on this CPU (virtual machine?)";
+  }
+
+  return std::string("perf_event_open failed: ") + std::strerror(error);
+}
+
+// The counters of one thread, opened as a group led by the first event
+class ThreadCounters {
+ public:
+  ThreadCounters() {
+    int error{0};
+
+    for (size_t i{0}; i < eventCount; ++i) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = eventConfigs[i];
+      // The leader starts disabled and switches the whole group
+      attr.disabled = leader_ < 0;
+      // User space only, which perf_event_paranoid=2 allows
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      fds_[i] = static_cast<int>(
+          ::syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0));
+
+      if (fds_[i] < 0) {
+        error = errno;
+        continue;
+      }
+
+      if (leader_ < 0) {
+        leader_ = fds_[i];
+      }
+    }
+
+    if (leader_ < 0) {
+      std::lock_guard<std::mutex> lock{totalsMutex};
+
+      if (totals.reason.empty()) {
+        totals.reason = openFailureReason(error);
+      }
+    }
+  }
+
+  ThreadCounters(const ThreadCounters&) = delete;
+  ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+  ~ThreadCounters() {
+    {
+      std::lock_guard<std::mutex> lock{totalsMutex};
+      addTo(totals);
+    }
+
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  bool start() {
+    return leader_ >= 0 &&
+           ::ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == 0;
+  }
+
+  void stop(size_t bytes) {
+    ::ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    bytes_ += bytes;
+  }
+
+  void addTo(PerfCounts& counts) const {
+    if (leader_ < 0) {
+      return;
+    }
+
+    counts.available = true;
+    counts.bytes += bytes_;
+
+    uint64_t* values[eventCount]{&counts.cycles, &counts.instructions,
+                                 &counts.cacheMisses, &counts.branchMisses};
+    bool* present[eventCount]{&counts.hasCycles, &counts.hasInstructions,
+                              &counts.hasCacheMisses, &counts.hasBranchMisses};
+
+    for (size_t i{0}; i < eventCount; ++i) {
+      uint64_t value{0};
+
+      if (fds_[i] >= 0 &&
+          ::read(fds_[i], &value, sizeof(value)) == sizeof(value)) {
+        *values[i] += value;
+        *present[i] = true;
+      }
+    }
+  }
+
+ private:
+  int fds_[eventCount]{-1, -1, -1, -1};
+  int leader_{-1};
+  uint64_t bytes_{0};
+};
+
+// Opened on the first XOR call of each thread, folded into totals at exit
+ThreadCounters& threadCounters() {
+  thread_local ThreadCounters counters;
+
+  return counters;
+}
+
+#endif
+
+}  // namespace
+
+void enablePerfCounters(bool enable) {
+  enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool perfCountersEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+PerfScope::PerfScope(size_t bytes) : bytes_(bytes) {
+  if (perfCountersEnabled()) {
+    active_ = threadCounters().start();
+  }
+}
+
+PerfScope::~PerfScope() {
+  if (active_) {
+    threadCounters().stop(bytes_);
+  }
+}
+
+PerfCounts collectPerfCounters() {
+  PerfCounts counts;
+
+  {
+    std::lock_guard<std::mutex> lock{totalsMutex};
+    counts = totals;
+  }
+
+  if (perfCountersEnabled()) {
+    threadCounters().addTo(counts);
+  }
+
+  return counts;
+}
+
+#else
+
+PerfScope::PerfScope(size_t bytes) {
+  (void)bytes;
+}
+
+PerfScope::~PerfScope() {}
+
+PerfCounts collectPerfCounters() {
+  PerfCounts counts;
+  counts.reason = "hardware counters need Linux perf_event_open";
+
+  return counts;
+}
+
+#endif
+
+std::string formatPerfCounters(const PerfCounts& counts) {
+  std::ostringstream report;
+
+  if (!counts.available) {
+    report << "Hardware counters unavailable: " << counts.reason << '\n';
+    return report.str();
+  }
+
+  const double bytes{static_cast<double>(counts.bytes ? counts.bytes : 1)};
+  report << "Hardware counters (XOR kernel, " << counts.bytes << " bytes):\n";
+
+  auto line{[&](const char* name, bool present, uint64_t value) {
+    report << "  " << name << ": ";
+
+    if (!present) {
+      report << "not supported\n";
+      return;
+    }
+
+    report << value << " (" << decimal(static_cast<double>(value) / bytes)
+           << " per byte)\n";
+  }};
+
+  line("cycles", counts.hasCycles, counts.cycles);
+  line("instructions", counts.hasInstructions, counts.instructions);
+  line("cache misses", counts.hasCacheMisses, counts.cacheMisses);
+  line("branch misses", counts.hasBranchMisses, counts.branchMisses);
+
+  if (counts.hasCycles && counts.hasInstructions && counts.cycles) {
+    report << "  instructions per cycle: "
+           << decimal(static_cast<double>(counts.instructions) /
+                      static_cast<double>(counts.cycles))
+           << '\n';
+  }
+
+  return report.str();
+}
@@ -0,0 +1,274 @@
+#include "../include/pipeline.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../include/buffers.hpp"
+#include "../include/fileio.hpp"
+#include "../include/stats.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+
+namespace {
+
+// Bounded lock-free ring with exactly one producer and one consumer thread
+template <typename T>
+class SpscRing {
+ public:
+  // One slot stays empty to tell a full ring from an empty one
+  explicit SpscRing(size_t capacity) : slots_(capacity + 1) {}
+
+  bool tryPush(const T& value) {
+    const size_t tail{tail_.load(std::memory_order_relaxed)};
+    const size_t next{(tail + 1) % slots_.size()};
+
+    if (next == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    slots_[tail] = value;
+    tail_.store(next, std::memory_order_release);
+
+    return true;
+  }
+
+  bool tryPop(T& value) {
+    const size_t head{head_.load(std::memory_order_relaxed)};
+
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = slots_[head];
+    head_.store((head + 1) % slots_.size(), std::memory_order_release);
+
+    return true;
+  }
+
+ private:
+  std::vector<T> slots_;
+  // Producer and consumer indices live on separate cache lines
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// A filled buffer travelling through the stages; len 0 marks end of stream
+struct Chunk {
+  unsigned slot;
+  uint64_t offset;
+  size_t len;
+};
+
+// Thrown inside a stage to unwind it when another stage failed
+struct Aborted {};
+
+// Spin briefly, then yield, then sleep, so idle stages do not burn a core
+class Backoff {
+ public:
+  void pause() {
+    if (++spins_ < 64) {
+      return;
+    }
+
+    if (spins_ < 256) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+
+ private:
+  unsigned spins_{0};
+};
+
+template <typename T>
+void pushWait(SpscRing<T>& ring, const T& value,
+              const std::atomic<bool>& aborted) {
+  Backoff backoff;
+
+  while (!ring.tryPush(value)) {
+    if (aborted.load(std::memory_order_relaxed)) {
+      throw Aborted{};
+    }
+
+    backoff.pause();
+  }
+}
+
+template <typename T>
+T popWait(SpscRing<T>& ring, const std::atomic<bool>& aborted) {
+  Backoff backoff;
+  T value{};
+
+  while (!ring.tryPop(value)) {
+    if (aborted.load(std::memory_order_relaxed)) {
+      throw Aborted{};
+    }
+
+    backoff.pause();
+  }
+
+  return value;
+}
+
+}  // namespace
+
+uint64_t runPipeline(int inputFd, int outputFd, std::string_view xorkey,
+                     const ProcessOptions& options,
+                     const PageCachePolicy* cache) {
+  FileHandle backup{openBackupFile(options.backupPath)};
+  const size_t chunkSize{std::max<size_t>(options.chunkSize, 1)};
+  const unsigned workers{std::max(options.pipelineWorkers, 1u)};
+  // Enough buffers for every stage to hold one while others are queued
+  const unsigned slotCount{2 * workers + 2};
+
+  std::vector<IoBuffer> buffers;
+  SpscRing<unsigned> freeSlots{slotCount};
+  std::vector<std::unique_ptr<SpscRing<Chunk>>> toWorker;
+  std::vector<std::unique_ptr<SpscRing<Chunk>>> toWriter;
+
+  for (unsigned slot{0}; slot < slotCount; ++slot) {
+    buffers.push_back(acquireBuffer(chunkSize));
+    freeSlots.tryPush(slot);
+  }
+
+  for (unsigned w{0}; w < workers; ++w) {
+    toWorker.push_back(std::make_unique<SpscRing<Chunk>>(slotCount));
+    toWriter.push_back(std::make_unique<SpscRing<Chunk>>(slotCount));
+  }
+
+  std::atomic<bool> aborted{false};
+  // errors[0] is the reader, then one per worker, the writer last
+  std::vector<std::exception_ptr> errors(workers + 2);
+
+  auto runStage{[&](size_t stage, auto&& body) {
+    try {
+      body();
+    } catch (const Aborted&) {
+    } catch (...) {
+      errors[stage] = std::current_exception();
+      aborted = true;
+    }
+  }};
+
+  std::vector<std::thread> threads;
+
+  // Reader: fill free buffers and deal them to the workers round-robin
+  threads.emplace_back([&] {
+    runStage(0, [&] {
+      uint64_t offset{0};
+      uint64_t sequence{0};
+
+      while (true) {
+        const unsigned slot{popWait(freeSlots, aborted)};
+        const size_t len{readFull(inputFd, buffers[slot].data(), chunkSize)};
+
+        if (len) {
+          if (backup) {
+            StageTimer timer{Stage::Backup};
+            writeFull(backup.get(), buffers[slot].data(), len);
+          }
+
+          pushWait(*toWorker[sequence++ % workers], Chunk{slot, offset, len},
+                   aborted);
+          offset += len;
+        }
+
+        // A short read means end of input
+        if (len < chunkSize) {
+          break;
+        }
+      }
+
+      for (unsigned w{0}; w < workers; ++w) {
+        pushWait(*toWorker[w], Chunk{0, offset, 0}, aborted);
+      }
+    });
+  });
+
+  // Workers: XOR each chunk at its stream offset and pass it on
+  for (unsigned w{0}; w < workers; ++w) {
+    threads.emplace_back([&, w] {
+      runStage(1 + w, [&] {
+        while (true) {
+          const Chunk chunk{popWait(*toWorker[w], aborted)};
+
+          if (chunk.len) {
+            xorWithLayout(
+                std::span<char>(buffers[chunk.slot].data(), chunk.len),
+                xorkey, chunk.offset, options);
+          }
+
+          pushWait(*toWriter[w], chunk, aborted);
+
+          if (!chunk.len) {
+            break;
+          }
+        }
+      });
+    });
+  }
+
+  // Writer (calling thread): collect chunks in reading order and recycle them
+  uint64_t written{0};
+  runStage(workers + 1, [&] {
+    for (uint64_t sequence{0};; ++sequence) {
+      const Chunk chunk{popWait(*toWriter[sequence % workers], aborted)};
+
+      if (!chunk.len) {
+        break;
+      }
+
+      writeFull(outputFd, buffers[chunk.slot].data(), chunk.len);
+      written += chunk.len;
+
+      if (cache) {
+        cache->release(chunk.offset, chunk.len, 0, cache->size());
+      }
+      pushWait(freeSlots, chunk.slot, aborted);
+    }
+  });
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const std::exception_ptr& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  return written;
+}
+
+void processFilePipeline(const std::string& filename,
+                         const std::string& outfile, std::string_view xorkey,
+                         const ProcessOptions& options) {
+  FileHandle input{openInputFile(filename)};
+  FileHandle output{openOutputFile(outfile)};
+  const PageCachePolicy cache{input, output, fileSize(input), false};
+
+  cache.finish(runPipeline(input.get(), output.get(), xorkey, options, &cache));
+}
+
+#else
+
+uint64_t runPipeline(int, int, std::string_view, const ProcessOptions&,
+                     const PageCachePolicy*) {
+  throw std::runtime_error("The pipeline requires POSIX I/O.");
+}
+
+void processFilePipeline(const std::string&, const std::string&,
+                         std::string_view, const ProcessOptions&) {
+  throw std::runtime_error("The pipeline requires POSIX I/O.");
+}
+
+#endif
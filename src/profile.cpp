@@ -0,0 +1,273 @@
+#include "../include/profile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "../include/backends.hpp"
+#include "../include/buffers.hpp"
+#include "../include/fileio.hpp"
+#include "../include/kernels.hpp"
+#include "../include/tuning.hpp"
+
+namespace {
+
+// Apply one "name=value" setting of a profile line; false if it is invalid
+bool applySetting(TuningProfile& profile, const std::string& setting) {
+  const size_t equals{setting.find('=')};
+
+  if (equals == std::string::npos) {
+    return false;
+  }
+
+  const std::string name{setting.substr(0, equals)};
+  const std::string value{setting.substr(equals + 1)};
+
+  try {
+    if (name == "volume") {
+      profile.volume = value;
+    } else if (name == "chunk") {
+      profile.chunkSize = parseChunkSize(value);
+    } else if (name == "threads") {
+      profile.threads = static_cast<unsigned>(
+          std::clamp<unsigned long>(std::stoul(value), 1, 1024));
+    } else if (name == "backend") {
+      profile.ioBackend = parseIoBackend(value);
+    } else if (name == "kernel") {
+      profile.kernel = value;
+    }
+  } catch (const std::exception&) {
+    return false;
+  }
+
+  // Settings added by later releases are ignored
+  return true;
+}
+
+std::optional<TuningProfile> parseProfile(const std::string& line) {
+  std::istringstream settings{line};
+  TuningProfile profile;
+  std::string setting;
+
+  while (settings >> setting) {
+    if (!applySetting(profile, setting)) {
+      return std::nullopt;
+    }
+  }
+
+  // Entries of earlier releases were keyed on the device number alone, which
+  // may name another device by now
+  if (profile.volume.empty()) {
+    return std::nullopt;
+  }
+
+  return profile;
+}
+
+// Seconds taken by a call
+template <typename Fn>
+double timed(Fn&& fn) {
+  const auto start{std::chrono::steady_clock::now()};
+  fn();
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Fastest XOR kernel on an in-memory buffer, left selected
+std::string calibrateKernel() {
+  IoBuffer buffer{acquireBuffer(8 * 1024 * 1024)};
+  const std::string key(Constants::generatedKeySize, 'k');
+  std::string best;
+  double bestTime{0};
+
+  for (const std::string& name : availableXorKernels()) {
+    selectXorKernel(name);
+    double elapsed{0};
+
+    for (int pass{0}; pass < 4; ++pass) {
+      elapsed += timed([&] { xorRange(buffer.span(), key, 0); });
+    }
+
+    if (best.empty() || elapsed < bestTime) {
+      best = name;
+      bestTime = elapsed;
+    }
+  }
+
+  selectXorKernel(best);
+
+  return best;
+}
+
+}  // namespace
+
+std::string defaultProfilePath() {
+  return (std::filesystem::path(getConfigDir()) / Constants::profileFileName)
+      .string();
+}
+
+std::string formatProfile(const TuningProfile& profile) {
+  return "volume=" + profile.volume +
+         " chunk=" + std::to_string(profile.chunkSize) +
+         " threads=" + std::to_string(profile.threads) +
+         " backend=" + ioBackendName(profile.ioBackend) +
+         " kernel=" + profile.kernel;
+}
+
+std::optional<TuningProfile> loadProfile(const std::string& profilePath,
+                                         const std::string& volume) {
+  std::ifstream file(profilePath);
+  std::string line;
+
+  while (std::getline(file, line)) {
+    std::optional<TuningProfile> profile{parseProfile(line)};
+
+    if (profile && profile->volume == volume) {
+      return profile;
+    }
+  }
+
+  return std::nullopt;
+}
+
+void saveProfile(const std::string& profilePath,
+                 const TuningProfile& profile) {
+  std::vector<std::string> lines;
+
+  {
+    std::ifstream file(profilePath);
+    std::string line;
+
+    // Keep the entries of other devices
+    while (std::getline(file, line)) {
+      std::optional<TuningProfile> other{parseProfile(line)};
+
+      if (!other || other->volume != profile.volume) {
+        lines.push_back(line);
+      }
+    }
+  }
+
+  lines.push_back(formatProfile(profile));
+
+  const std::filesystem::path parent{
+      std::filesystem::path(profilePath).parent_path()};
+
+  if (!parent.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(parent, error);
+  }
+
+  std::ofstream file(profilePath, std::ios::trunc);
+
+  for (const std::string& line : lines) {
+    file << line << '\n';
+  }
+
+  if (!file) {
+    throw std::runtime_error("Unable to write tuning profile: " + profilePath);
+  }
+}
+
+#ifdef DYNOXOR_POSIX_IO
+
+TuningProfile calibrateDevice(const std::string& filename) {
+  TuningProfile profile;
+  profile.volume = probeStorage(filename).volume;
+  profile.kernel = calibrateKernel();
+
+  const size_t chunkSize{calibrateChunkSize(
+      filename, {64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024})};
+  profile.chunkSize = chunkSize ? chunkSize : autoChunkSize(filename);
+
+  // Engines are timed on a copy next to the input, on the same device
+  const std::string sample{filename + ".calibrate.tmp"};
+  const std::string output{filename + ".calibrate.out.tmp"};
+
+  try {
+    FileHandle input{openInputFile(filename)};
+    FileHandle copy{openOutputFile(sample)};
+    IoBuffer buffer{acquireBuffer(1024 * 1024)};
+    const uint64_t sampleSize{std::min(fileSize(input), calibrationSample)};
+
+    for (uint64_t offset{0}; offset < sampleSize; offset += buffer.size()) {
+      const size_t len{static_cast<size_t>(
+          std::min<uint64_t>(buffer.size(), sampleSize - offset))};
+      writeAt(copy, buffer.data(), readAt(input, buffer.data(), len, offset),
+              offset);
+    }
+
+    struct Candidate {
+      IoBackend backend;
+      unsigned threads;
+    };
+
+    std::vector<Candidate> candidates{{IoBackend::Stream, 1},
+                                      {IoBackend::Posix, 1}};
+
+    if (uringSupported()) {
+      candidates.push_back({IoBackend::Uring, 1});
+    }
+
+    const unsigned cores{std::max(std::thread::hardware_concurrency(), 1u)};
+
+    for (unsigned threads{2}; threads < cores; threads *= 2) {
+      candidates.push_back({IoBackend::Posix, threads});
+    }
+
+    if (cores > 1) {
+      candidates.push_back({IoBackend::Posix, cores});
+    }
+
+    const std::string key(Constants::generatedKeySize, 'k');
+    double bestTime{0};
+    bool first{true};
+
+    // One untimed pass so every candidate starts from the same cache state
+    processFileInChunks(sample, output, key,
+                        ProcessOptions{.chunkSize = profile.chunkSize});
+
+    for (const Candidate& candidate : candidates) {
+      const double elapsed{timed([&] {
+        processFileInChunks(sample, output, key,
+                            ProcessOptions{.chunkSize = profile.chunkSize,
+                                           .threads = candidate.threads,
+                                           .ioBackend = candidate.backend});
+      })};
+
+      if (first || elapsed < bestTime) {
+        profile.ioBackend = candidate.backend;
+        profile.threads = candidate.threads;
+        bestTime = elapsed;
+        first = false;
+      }
+    }
+  } catch (...) {
+    std::error_code ignored;
+    std::filesystem::remove(sample, ignored);
+    std::filesystem::remove(output, ignored);
+    throw;
+  }
+
+  std::filesystem::remove(sample);
+  std::filesystem::remove(output);
+
+  return profile;
+}
+
+#else
+
+TuningProfile calibrateDevice(const std::string&) {
+  throw std::runtime_error("Calibration requires POSIX I/O.");
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include "../include/stats.hpp"
+#include <atomic>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include "../include/fileio.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::atomic<bool> enabled{false};
+std::atomic<uint64_t> processedBytes{0};
+std::array<std::atomic<uint64_t>, stageCount> stageNanoseconds{};
+std::array<std::atomic<uint64_t>, stageCount> stageSyscalls{};
+
+// Stage of the outermost timer running on this thread, -1 if none
+thread_local int activeStage{-1};
+
+size_t index(Stage stage) {
+  return static_cast<size_t>(stage);
+}
+
+uint64_t peakResidentSetSize() {
+#ifdef DYNOXOR_POSIX_IO
+  struct rusage usage {};
+
+  if (::getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+
+#ifdef __APPLE__
+  // Bytes on macOS, KiB elsewhere
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+std::string fixed(double value, int decimals) {
+  char text[64];
+  std::snprintf(text, sizeof(text), "%.*f", decimals, value);
+
+  return text;
+}
+
+double gibPerSecond(const RunStats& stats) {
+  if (stats.wallSeconds <= 0) {
+    return 0;
+  }
+
+  return static_cast<double>(stats.bytes) / (1024.0 * 1024 * 1024) /
+         stats.wallSeconds;
+}
+
+}  // namespace
+
+std::string stageName(Stage stage) {
+  switch (stage) {
+    case Stage::Read:
+      return "read";
+    case Stage::Xor:
+      return "xor";
+    case Stage::Write:
+      return "write";
+    case Stage::Sync:
+      return "fsync";
+    case Stage::Backup:
+      return "backup";
+    case Stage::Rename:
+      break;
+  }
+
+  return "rename";
+}
+
+void enableStats(bool enable) {
+  enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool statsEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void resetStats() {
+  processedBytes = 0;
+
+  for (size_t i{0}; i < stageCount; ++i) {
+    stageNanoseconds[i] = 0;
+    stageSyscalls[i] = 0;
+  }
+}
+
+void addProcessedBytes(uint64_t bytes) {
+  if (statsEnabled()) {
+    processedBytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+void countSyscall() {
+  if (statsEnabled() && activeStage >= 0) {
+    stageSyscalls[static_cast<size_t>(activeStage)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+}
+
+StageTimer::StageTimer(Stage stage) : stage_(stage) {
+  if (!statsEnabled() || activeStage >= 0) {
+    return;
+  }
+
+  outermost_ = true;
+  activeStage = static_cast<int>(index(stage));
+  start_ = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+  if (!outermost_) {
+    return;
+  }
+
+  const auto elapsed{std::chrono::steady_clock::now() - start_};
+  stageNanoseconds[index(stage_)].fetch_add(
+      static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+              .count()),
+      std::memory_order_relaxed);
+  activeStage = -1;
+}
+
+RunStats collectStats(double wallSeconds) {
+  RunStats stats;
+  stats.bytes = processedBytes.load();
+  stats.wallSeconds = wallSeconds;
+  stats.peakRss = peakResidentSetSize();
+
+  for (size_t i{0}; i < stageCount; ++i) {
+    stats.stageSeconds[i] =
+        static_cast<double>(stageNanoseconds[i].load()) / 1e9;
+    stats.syscalls[i] = stageSyscalls[i].load();
+  }
+
+  return stats;
+}
+
+std::string formatStats(const RunStats& stats) {
+  std::ostringstream report;
+  report << "Bytes processed: " << stats.bytes << '\n'
+         << "Wall time: " << fixed(stats.wallSeconds, 3) << " s\n"
+         << "Throughput: " << fixed(gibPerSecond(stats), 3) << " GiB/s\n";
+
+  for (size_t i{0}; i < stageCount; ++i) {
+    report << "  " << stageName(static_cast<Stage>(i)) << ": "
+           << fixed(stats.stageSeconds[i], 3) << " s, " << stats.syscalls[i]
+           << " syscalls\n";
+  }
+
+  report << "Peak RSS: " << stats.peakRss / 1024 << " KiB\n";
+
+  return report.str();
+}
+
+std::string formatStatsJson(const RunStats& stats) {
+  std::ostringstream json;
+  json << "{\"bytes\": " << stats.bytes
+       << ", \"wall_seconds\": " << fixed(stats.wallSeconds, 6)
+       << ", \"gib_per_second\": " << fixed(gibPerSecond(stats), 6)
+       << ", \"stages\": {";
+
+  for (size_t i{0}; i < stageCount; ++i) {
+    json << (i ? ", " : "") << '"' << stageName(static_cast<Stage>(i))
+         << "\": {\"seconds\": " << fixed(stats.stageSeconds[i], 6)
+         << ", \"syscalls\": " << stats.syscalls[i] << '}';
+  }
+
+  json << "}, \"peak_rss_bytes\": " << stats.peakRss << "}\n";
+
+  return json.str();
+}
@@ -0,0 +1,288 @@
+#include "../include/streaming.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include "../include/buffers.hpp"
+#include "../include/constants.hpp"
+#include "../include/fileio.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/stats.hpp"
+
+bool isStandardStream(const std::string& path) {
+  return path == Constants::streamPath;
+}
+
+#ifdef DYNOXOR_POSIX_IO
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// Pipe size requested for standard streams (Linux caps it at pipe-max-size)
+constexpr int requestedPipeSize{1024 * 1024};
+
+bool isPipe(int fd) {
+  struct stat info {};
+
+  return ::fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
+// Enlarge a pipe so each syscall moves more data; returns its size or 0
+size_t growPipe(int fd) {
+#ifdef F_SETPIPE_SZ
+  if (!isPipe(fd)) {
+    return 0;
+  }
+
+  // Unprivileged callers may be refused above pipe-max-size; keep going
+  ::fcntl(fd, F_SETPIPE_SZ, requestedPipeSize);
+  int size{::fcntl(fd, F_GETPIPE_SZ)};
+
+  return size > 0 ? static_cast<size_t>(size) : 0;
+#else
+  (void)fd;
+  return 0;
+#endif
+}
+
+// Fused backup: the chunk as read, before it is XORed
+void writeBackup(const FileHandle& backup, const char* data, size_t len) {
+  if (backup) {
+    StageTimer timer{Stage::Backup};
+    writeFull(backup.get(), data, len);
+  }
+}
+
+#ifdef __linux__
+
+// Hand a buffer's pages to a pipe; false if vmsplice is not usable.
+// The pages are gifted: the caller must never write them again
+bool vmspliceFull(int fd, const char* data, size_t len) {
+  StageTimer timer{Stage::Write};
+
+  while (len) {
+    countSyscall();
+    iovec iov{const_cast<char*>(data), len};
+    ssize_t n{::vmsplice(fd, &iov, 1, SPLICE_F_GIFT)};
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      // Let the caller write whatever is left
+      if (errno == EINVAL || errno == ENOSYS || errno == EBADF) {
+        writeFull(fd, data, len);
+        return false;
+      }
+
+      throw std::runtime_error(std::string("Failed writing output: ") +
+                               std::strerror(errno));
+    }
+
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+
+  return true;
+}
+
+// Copy-free output to a pipe. A spliced page is referenced by the pipe, and
+// by whatever the reader splices or tees it on to, for as long as they like,
+// so it is never written again: every turn reads into freshly mapped pages,
+// and unmapping them only drops our own reference.
+// Once vmsplice is refused the output is copied by write, and one buffer is
+// reused from then on.
+void spliceToPipe(int inputFd, int outputFd, size_t pipeSize,
+                  const FileHandle& backup, std::string_view xorkey,
+                  const ProcessOptions& options) {
+  const size_t pageSize{static_cast<size_t>(::sysconf(_SC_PAGESIZE))};
+  const size_t half{std::max(pipeSize / 2 / pageSize, size_t{1}) * pageSize};
+  const auto unmap{[half](char* data) { ::munmap(data, half); }};
+  // Not pooled: pooled buffers are refilled
+  std::unique_ptr<char, decltype(unmap)> buffer{nullptr, unmap};
+
+  bool splicing{true};
+  uint64_t offset{0};
+
+  while (true) {
+    if (splicing || !buffer) {
+      void* mapped{::mmap(nullptr, half, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+
+      if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Failed to allocate pipe buffers.");
+      }
+
+      buffer.reset(static_cast<char*>(mapped));
+    }
+
+    const size_t len{readFull(inputFd, buffer.get(), half)};
+
+    if (len) {
+      writeBackup(backup, buffer.get(), len);
+      xorWithLayout(std::span<char>(buffer.get(), len), xorkey, offset,
+                    options);
+
+      if (splicing) {
+        splicing = vmspliceFull(outputFd, buffer.get(), len);
+      } else {
+        writeFull(outputFd, buffer.get(), len);
+      }
+
+      offset += len;
+    }
+
+    if (len < half) {
+      break;
+    }
+  }
+}
+
+#endif
+
+}  // namespace
+
+void processStreamInChunks(const std::string& filename,
+                           const std::string& outfile,
+                           std::string_view xorkey,
+                           const ProcessOptions& options) {
+  FileHandle ownedInput;
+  FileHandle ownedOutput;
+
+  if (!isStandardStream(filename)) {
+    ownedInput = openInputFile(filename);
+  }
+
+  if (!isStandardStream(outfile)) {
+    ownedOutput = openOutputFile(outfile);
+  }
+
+  const int inputFd{ownedInput ? ownedInput.get() : STDIN_FILENO};
+  const int outputFd{ownedOutput ? ownedOutput.get() : STDOUT_FILENO};
+
+  growPipe(inputFd);
+  [[maybe_unused]] const size_t outputPipeSize{growPipe(outputFd)};
+
+  // The pipeline writes the fused backup from its reader thread
+  if (options.pipelineWorkers > 0) {
+    runPipeline(inputFd, outputFd, xorkey, options);
+    return;
+  }
+
+  FileHandle backup{openBackupFile(options.backupPath)};
+
+#ifdef __linux__
+  if (outputPipeSize) {
+    spliceToPipe(inputFd, outputFd, outputPipeSize, backup, xorkey, options);
+    return;
+  }
+#endif
+
+  IoBuffer buffer{acquireBuffer(options.chunkSize)};
+  uint64_t offset{0};
+
+  while (true) {
+    const size_t len{readFull(inputFd, buffer.data(), buffer.size())};
+
+    if (len) {
+      writeBackup(backup, buffer.data(), len);
+      xorWithLayout(buffer.span().first(len), xorkey, offset, options);
+      writeFull(outputFd, buffer.data(), len);
+      offset += len;
+    }
+
+    if (len < buffer.size()) {
+      break;
+    }
+  }
+}
+
+#else
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+void processStreamInChunks(const std::string& filename,
+                           const std::string& outfile,
+                           std::string_view xorkey,
+                           const ProcessOptions& options) {
+#ifdef _WIN32
+  // Standard streams default to text mode, which would mangle binary data
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+  // C stdio is used so the data bypasses std::cout, which main may redirect
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> inputFile{
+      isStandardStream(filename) ? nullptr
+                                 : std::fopen(filename.c_str(), "rb"),
+      &std::fclose};
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> outputFile{
+      isStandardStream(outfile) ? nullptr : std::fopen(outfile.c_str(), "wb"),
+      &std::fclose};
+
+  std::FILE* input{isStandardStream(filename) ? stdin : inputFile.get()};
+  std::FILE* output{isStandardStream(outfile) ? stdout : outputFile.get()};
+
+  if (!input || !output) {
+    throw std::runtime_error("Failed to open input or output stream.");
+  }
+
+  // Fused backup receives every chunk before it is XORed
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> backup{
+      options.backupPath.empty()
+          ? nullptr
+          : std::fopen(options.backupPath.c_str(), "wb"),
+      &std::fclose};
+
+  if (!options.backupPath.empty() && !backup) {
+    throw std::runtime_error("Error opening backup file for writing: " +
+                             options.backupPath);
+  }
+
+  IoBuffer buffer{acquireBuffer(options.chunkSize)};
+  uint64_t offset{0};
+
+  while (true) {
+    const size_t len{std::fread(buffer.data(), 1, buffer.size(), input)};
+
+    if (!len) {
+      break;
+    }
+
+    if (backup &&
+        std::fwrite(buffer.data(), 1, len, backup.get()) != len) {
+      throw std::runtime_error("Error writing backup file: " +
+                               options.backupPath);
+    }
+
+    xorWithLayout(buffer.span().first(len), xorkey, offset, options);
+
+    if (std::fwrite(buffer.data(), 1, len, output) != len) {
+      throw std::runtime_error("Failed writing to output stream.");
+    }
+
+    offset += len;
+  }
+
+  if (std::ferror(input) || std::fflush(output) != 0 ||
+      (backup && std::fflush(backup.get()) != 0)) {
+    throw std::runtime_error("Failed streaming data.");
+  }
+}
+
+#endif
@@ -0,0 +1,368 @@
+#include "../include/tuning.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include "../include/buffers.hpp"
+#include "../include/constants.hpp"
+#include "../include/fileio.hpp"
+#include "../include/streaming.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace {
+
+constexpr size_t kib{1024};
+constexpr size_t mib{1024 * kib};
+constexpr size_t maxChunkSize{1024 * mib};
+// Range explored around the starting guess by the calibration run
+constexpr size_t minAutoChunk{64 * kib};
+constexpr size_t maxAutoChunk{16 * mib};
+
+size_t roundUp(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+// Starting guess for a kind of storage, before calibration
+size_t baseChunkSize(StorageKind kind) {
+  switch (kind) {
+    case StorageKind::Network:
+    case StorageKind::Rotational:
+      // Few, large requests: high latency per request or per seek
+      return 1 * mib;
+    case StorageKind::SolidState:
+    case StorageKind::Unknown:
+      break;
+  }
+
+  return 256 * kib;
+}
+
+#ifdef __linux__
+
+// Filesystem magic numbers (statfs f_type) of network filesystems
+bool isNetworkFilesystem(long type) {
+  switch (static_cast<unsigned long>(type) & 0xffffffffu) {
+    case 0x6969:      // NFS
+    case 0x517b:      // SMB
+    case 0xff534d42:  // CIFS
+    case 0xfe534d42:  // SMB2
+    case 0x00c36400:  // Ceph
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Read /sys/dev/block/<major>:<minor>/queue/rotational; partitions keep the
+// queue directory on their parent disk
+int readRotational(unsigned major, unsigned minor) {
+  const std::string device{"/sys/dev/block/" + std::to_string(major) + ':' +
+                           std::to_string(minor)};
+
+  for (const char* queue : {"/queue/rotational", "/../queue/rotational"}) {
+    std::ifstream flag(device + queue);
+    int rotational{-1};
+
+    if (flag >> rotational) {
+      return rotational;
+    }
+  }
+
+  return -1;
+}
+
+// Undo the octal escapes (\040 for a space) of a /proc/self/mountinfo field
+std::string unescapeMountField(const std::string& field) {
+  std::string plain;
+
+  for (size_t i{0}; i < field.size(); ++i) {
+    if (field[i] == '\\' && i + 3 < field.size() &&
+        std::isdigit(static_cast<unsigned char>(field[i + 1]))) {
+      plain += static_cast<char>(std::stoi(field.substr(i + 1, 3), nullptr, 8));
+      i += 3;
+    } else {
+      plain += field[i];
+    }
+  }
+
+  return plain;
+}
+
+// Mount point and source of the innermost mount of a device holding path,
+// from /proc/self/mountinfo, as escaped there (no spaces); empty if unknown
+std::pair<std::string, std::string> findMount(const std::string& path,
+                                              dev_t device) {
+  std::error_code error;
+  const std::string canonical{
+      std::filesystem::weakly_canonical(path, error).string()};
+  const std::string wanted{std::to_string(::major(device)) + ':' +
+                           std::to_string(::minor(device))};
+  std::ifstream mounts("/proc/self/mountinfo");
+  std::pair<std::string, std::string> best;
+  std::string line;
+
+  // id parent major:minor root mountpoint options [tags] - type source ...
+  while (std::getline(mounts, line)) {
+    std::istringstream fields{line};
+    std::string id, parent, numbers, root, mountPoint, field;
+    fields >> id >> parent >> numbers >> root >> mountPoint;
+
+    while (fields >> field && field != "-") {
+    }
+
+    std::string type, source;
+    fields >> type >> source;
+
+    const std::string plain{unescapeMountField(mountPoint)};
+    const bool contains{
+        canonical.rfind(plain, 0) == 0 &&
+        (plain == "/" || canonical.size() == plain.size() ||
+         canonical[plain.size()] == '/')};
+
+    if (numbers == wanted && contains &&
+        mountPoint.size() >= best.first.size()) {
+      best = {mountPoint, source};
+    }
+  }
+
+  return best;
+}
+
+// UUID of the filesystem on a block device, from /dev/disk/by-uuid
+std::string findFilesystemUuid(dev_t device) {
+  std::error_code error;
+
+  for (const std::filesystem::directory_entry& entry :
+       std::filesystem::directory_iterator("/dev/disk/by-uuid", error)) {
+    struct stat target {};
+
+    if (::stat(entry.path().c_str(), &target) == 0 &&
+        S_ISBLK(target.st_mode) && target.st_rdev == device) {
+      return entry.path().filename().string();
+    }
+  }
+
+  return "";
+}
+
+#endif
+
+#ifdef DYNOXOR_POSIX_IO
+
+// Name of the filesystem holding a file that survives reboots and device
+// renumbering. The device number alone is only trusted within one boot
+std::string volumeName(const std::string& filename, dev_t device) {
+#ifdef __linux__
+  const auto [mountPoint, source] = findMount(filename, device);
+
+  if (!mountPoint.empty()) {
+    const std::string uuid{findFilesystemUuid(device)};
+
+    return (uuid.empty() ? source : "uuid:" + uuid) + '@' + mountPoint;
+  }
+
+  std::ifstream bootId("/proc/sys/kernel/random/boot_id");
+  std::string boot;
+
+  if (bootId >> boot) {
+    return "boot:" + boot + "/dev:" + std::to_string(device);
+  }
+#endif
+
+  return "dev:" + std::to_string(device);
+}
+
+#endif
+
+}  // namespace
+
+size_t parseChunkSize(const std::string& value) {
+  if (value == "auto") {
+    return 0;
+  }
+
+  size_t digits{0};
+
+  while (digits < value.size() &&
+         std::isdigit(static_cast<unsigned char>(value[digits]))) {
+    ++digits;
+  }
+
+  const std::string suffix{value.substr(digits)};
+  size_t unit{1};
+
+  if (suffix == "K" || suffix == "k") {
+    unit = kib;
+  } else if (suffix == "M" || suffix == "m") {
+    unit = mib;
+  } else if (suffix == "G" || suffix == "g") {
+    unit = 1024 * mib;
+  } else if (!suffix.empty()) {
+    throw std::runtime_error("Invalid chunk size: " + value);
+  }
+
+  // Limit the digits so the multiplication below cannot overflow
+  if (!digits || digits > 10) {
+    throw std::runtime_error("Invalid chunk size: " + value);
+  }
+
+  const uint64_t size{std::stoull(value.substr(0, digits)) * unit};
+
+  if (!size || size > maxChunkSize) {
+    throw std::runtime_error("Chunk size must be between 1 byte and 1G: " +
+                             value);
+  }
+
+  return static_cast<size_t>(size);
+}
+
+std::string storageKindName(StorageKind kind) {
+  switch (kind) {
+    case StorageKind::Rotational:
+      return "rotational";
+    case StorageKind::SolidState:
+      return "ssd";
+    case StorageKind::Network:
+      return "network";
+    case StorageKind::Unknown:
+      break;
+  }
+
+  return "unknown";
+}
+
+StorageInfo probeStorage(const std::string& filename) {
+  StorageInfo info;
+
+#ifdef DYNOXOR_POSIX_IO
+  struct stat fileInfo {};
+
+  if (::stat(filename.c_str(), &fileInfo) != 0) {
+    return info;
+  }
+
+  info.device = static_cast<uint64_t>(fileInfo.st_dev);
+  info.volume = volumeName(filename, fileInfo.st_dev);
+  info.blockSize =
+      static_cast<size_t>(std::max<blksize_t>(fileInfo.st_blksize, 0));
+#else
+  (void)filename;
+#endif
+
+#ifdef __linux__
+  struct statfs filesystem {};
+
+  if (::statfs(filename.c_str(), &filesystem) == 0 &&
+      isNetworkFilesystem(filesystem.f_type)) {
+    info.kind = StorageKind::Network;
+    return info;
+  }
+
+  // Major 0 is used by virtual filesystems (tmpfs, overlayfs, btrfs, ...)
+  const unsigned major{::major(fileInfo.st_dev)};
+
+  if (major) {
+    const int rotational{readRotational(major, ::minor(fileInfo.st_dev))};
+
+    if (rotational >= 0) {
+      info.kind =
+          rotational ? StorageKind::Rotational : StorageKind::SolidState;
+    }
+  }
+#endif
+
+  return info;
+}
+
+#ifdef DYNOXOR_POSIX_IO
+
+size_t calibrateChunkSize(const std::string& filename,
+                          const std::vector<size_t>& candidates) {
+  FileHandle input{openInputFile(filename)};
+
+  if (candidates.empty() ||
+      fileSize(input) < calibrationWindow * candidates.size()) {
+    return 0;
+  }
+
+  size_t best{0};
+  double bestTime{0};
+  uint64_t windowStart{0};
+
+  for (size_t candidate : candidates) {
+    IoBuffer buffer{acquireBuffer(candidate)};
+    const auto start{std::chrono::steady_clock::now()};
+
+    for (uint64_t offset{0}; offset < calibrationWindow; offset += candidate) {
+      const size_t len{static_cast<size_t>(
+          std::min<uint64_t>(candidate, calibrationWindow - offset))};
+      readAt(input, buffer.data(), len, windowStart + offset);
+    }
+
+    const double elapsed{std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count()};
+
+    if (!best || elapsed < bestTime) {
+      best = candidate;
+      bestTime = elapsed;
+    }
+
+    windowStart += calibrationWindow;
+  }
+
+  return best;
+}
+
+#else
+
+size_t calibrateChunkSize(const std::string&, const std::vector<size_t>&) {
+  return 0;
+}
+
+#endif
+
+size_t autoChunkSize(const std::string& filename) {
+  if (isStandardStream(filename)) {
+    return Constants::chunkSize;
+  }
+
+  const StorageInfo info{probeStorage(filename)};
+  const size_t blockSize{std::max<size_t>(info.blockSize, 4 * kib)};
+  const size_t base{baseChunkSize(info.kind)};
+  std::error_code error;
+  const uint64_t size{std::filesystem::file_size(filename, error)};
+
+  if (error) {
+    return Constants::chunkSize;
+  }
+
+  // A file that fits in one chunk is read in one request
+  if (size <= base) {
+    return roundUp(static_cast<size_t>(std::max<uint64_t>(size, 1)),
+                   blockSize);
+  }
+
+  const size_t calibrated{calibrateChunkSize(
+      filename, {base, std::max(base / 4, minAutoChunk),
+                 std::min(base * 4, maxAutoChunk)})};
+
+  return roundUp(calibrated ? calibrated : base, blockSize);
+}
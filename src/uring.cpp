@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../include/backends.hpp"
+#include "../include/buffers.hpp"
+#include "../include/fileio.hpp"
+#include "../include/stats.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DYNOXOR_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef DYNOXOR_URING
+
+namespace {
+
+// Build an error message carrying the description of a negative errno value
+std::runtime_error uringError(const std::string& what, int error) {
+  return std::runtime_error(what + ": " + std::strerror(error));
+}
+
+// Unmaps a ring region of the size it was mapped with
+struct RingUnmapper {
+  size_t size;
+
+  void operator()(void* ring) const { ::munmap(ring, size); }
+};
+
+// A mapped ring region, released even when a later step of the constructor
+// throws and the destructor never runs
+using RingMapping = std::unique_ptr<void, RingUnmapper>;
+
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency)
+class Ring {
+ public:
+  explicit Ring(unsigned entries) {
+    io_uring_params params{};
+    FileHandle fd{static_cast<int>(
+        ::syscall(__NR_io_uring_setup, entries, &params))};
+
+    if (!fd) {
+      throw uringError("io_uring_setup failed", errno);
+    }
+
+    sqRing_ = mapRing(
+        fd, params.sq_off.array + params.sq_entries * sizeof(unsigned),
+        IORING_OFF_SQ_RING);
+    cqRing_ = mapRing(
+        fd, params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe),
+        IORING_OFF_CQ_RING);
+    sqesRing_ = mapRing(fd, params.sq_entries * sizeof(io_uring_sqe),
+                        IORING_OFF_SQES);
+    sqes_ = static_cast<io_uring_sqe*>(sqesRing_.get());
+
+    char* sq{static_cast<char*>(sqRing_.get())};
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq{static_cast<char*>(cqRing_.get())};
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    fd_ = std::move(fd);
+  }
+
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  // The rings are unmapped, then the fd closed, once drained
+  ~Ring() { drain(); }
+
+  // Whether the kernel implements an opcode; the probe itself, like the plain
+  // read and write opcodes, is missing before Linux 5.6
+  bool supports(uint8_t opcode) const {
+    constexpr unsigned probedOps{256};
+    // uint64_t storage keeps the flexible array suitably aligned
+    std::vector<uint64_t> storage(
+        (sizeof(io_uring_probe) + probedOps * sizeof(io_uring_probe_op) + 7) /
+        8);
+    auto* probe{reinterpret_cast<io_uring_probe*>(storage.data())};
+
+    if (::syscall(__NR_io_uring_register, fd_.get(), IORING_REGISTER_PROBE,
+                  probe, probedOps) != 0) {
+      return false;
+    }
+
+    return opcode < probe->ops_len &&
+           (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+
+  // Pin the I/O buffers once so reads and writes skip per-request mapping
+  bool registerBuffers(const std::vector<iovec>& buffers) {
+    return ::syscall(__NR_io_uring_register, fd_.get(),
+                     IORING_REGISTER_BUFFERS, buffers.data(),
+                     static_cast<unsigned>(buffers.size())) == 0;
+  }
+
+  // Queue one read or write; bufIndex < 0 means the buffer is not registered
+  void push(uint8_t opcode, int fd, char* data, size_t len, uint64_t offset,
+            int bufIndex, uint64_t userData) {
+    const unsigned tail{*sqTail_};
+
+    if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+      submit(0);
+    }
+
+    const unsigned index{tail & sqMask_};
+    io_uring_sqe* sqe{&sqes_[index]};
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(std::max(bufIndex, 0));
+    sqe->user_data = userData;
+    sqArray_[index] = index;
+
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+  }
+
+  // Submit queued requests and wait for at least minComplete completions
+  void submit(unsigned minComplete) {
+    // Waits for reads and writes alike; reported as read time
+    StageTimer timer{Stage::Read};
+
+    while (true) {
+      countSyscall();
+      long submitted{::syscall(__NR_io_uring_enter, fd_.get(), pending_,
+                               minComplete,
+                               minComplete ? IORING_ENTER_GETEVENTS : 0,
+                               nullptr, 0)};
+
+      if (submitted < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        throw uringError("io_uring_enter failed", errno);
+      }
+
+      const unsigned accepted{
+          std::min(pending_, static_cast<unsigned>(submitted))};
+      pending_ -= accepted;
+      inFlight_ += accepted;
+
+      if (!pending_) {
+        return;
+      }
+    }
+  }
+
+  bool pop(io_uring_cqe& cqe) {
+    const unsigned head{*cqHead_};
+
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+
+    cqe = cqes_[head & cqMask_];
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    --inFlight_;
+
+    return true;
+  }
+
+ private:
+  // Wait out the requests the kernel still holds, so that an error thrown
+  // mid-run never frees buffers a read or write is about to land in.
+  // Queued but unsubmitted requests are never seen by the kernel
+  void drain() noexcept {
+    io_uring_cqe cqe{};
+
+    while (inFlight_) {
+      if (::syscall(__NR_io_uring_enter, fd_.get(), 0, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return;
+      }
+
+      while (pop(cqe)) {
+      }
+    }
+  }
+
+  static RingMapping mapRing(const FileHandle& fd, size_t size,
+                             uint64_t offset) {
+    void* ring{::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd.get(),
+                      static_cast<off_t>(offset))};
+
+    if (ring == MAP_FAILED) {
+      throw uringError("Failed to map io_uring ring", errno);
+    }
+
+    return RingMapping{ring, RingUnmapper{size}};
+  }
+
+  // Declared first, so it is closed after the mappings below are released
+  FileHandle fd_;
+  RingMapping sqRing_;
+  RingMapping cqRing_;
+  RingMapping sqesRing_;
+  io_uring_sqe* sqes_{nullptr};
+  unsigned* sqHead_{nullptr};
+  unsigned* sqTail_{nullptr};
+  unsigned* sqArray_{nullptr};
+  unsigned sqMask_{0};
+  unsigned sqEntries_{0};
+  unsigned* cqHead_{nullptr};
+  unsigned* cqTail_{nullptr};
+  unsigned cqMask_{0};
+  io_uring_cqe* cqes_{nullptr};
+  // Queued, not yet submitted
+  unsigned pending_{0};
+  // Submitted, completion not yet popped
+  unsigned inFlight_{0};
+};
+
+// One in-flight chunk: its buffer and the file range it covers
+struct Slot {
+  char* data;
+  uint64_t offset;
+  size_t len;
+};
+
+}  // namespace
+
+bool uringSupported() {
+  try {
+    // Runs whose buffers cannot be registered fall back to the plain read
+    // and write opcodes, so those must exist as well as the ring
+    Ring ring{1};
+    return ring.supports(IORING_OP_READ) && ring.supports(IORING_OP_WRITE);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+}
+
+void processFileUring(const std::string& filename, const std::string& outfile,
+                      std::string_view xorkey, const ProcessOptions& options) {
+  FileHandle input{openInputFile(filename)};
+  FileHandle output{openOutputFile(outfile)};
+  FileHandle backup{openBackupFile(options.backupPath)};
+  const uint64_t size{fileSize(input)};
+  // Direct runs go through the posix backend, so only the hints apply here
+  const PageCachePolicy cache{input, output, size, false};
+  const size_t chunkSize{std::max<size_t>(options.chunkSize, 1)};
+  const unsigned depth{std::max(options.queueDepth, 1u)};
+
+  // One contiguous allocation carved into queue-depth buffers; declared
+  // before the ring so that the ring drains before they are released
+  IoBuffer storage{acquireBuffer(chunkSize * depth)};
+  Ring ring{depth * 2};
+  std::vector<Slot> slots(depth);
+  std::vector<iovec> iovecs(depth);
+
+  for (unsigned i{0}; i < depth; ++i) {
+    slots[i].data = storage.data() + i * chunkSize;
+    iovecs[i] = {slots[i].data, chunkSize};
+  }
+
+  const bool fixed{ring.registerBuffers(iovecs)};
+  const uint8_t readOp{fixed ? uint8_t{IORING_OP_READ_FIXED}
+                             : uint8_t{IORING_OP_READ}};
+  const uint8_t writeOp{fixed ? uint8_t{IORING_OP_WRITE_FIXED}
+                              : uint8_t{IORING_OP_WRITE}};
+
+  uint64_t nextRead{0};
+  unsigned inFlight{0};
+  std::exception_ptr error;
+
+  // user_data = slot index * 2 + (0 for a read, 1 for a write)
+  auto startRead{[&](unsigned index) {
+    Slot& slot{slots[index]};
+    slot.offset = nextRead;
+    slot.len = static_cast<size_t>(std::min<uint64_t>(chunkSize, size - nextRead));
+    nextRead += slot.len;
+
+    ring.push(readOp, input.get(), slot.data, slot.len, slot.offset,
+              fixed ? static_cast<int>(index) : -1, uint64_t{index} * 2);
+    ++inFlight;
+  }};
+
+  for (unsigned i{0}; i < depth && nextRead < size; ++i) {
+    startRead(i);
+  }
+
+  while (inFlight) {
+    ring.submit(1);
+    io_uring_cqe cqe{};
+
+    while (ring.pop(cqe)) {
+      const unsigned index{static_cast<unsigned>(cqe.user_data / 2)};
+      const bool isWrite{(cqe.user_data & 1) != 0};
+      Slot& slot{slots[index]};
+
+      // Once an error is recorded, only drain the requests still in flight
+      try {
+        if (error) {
+          --inFlight;
+          continue;
+        }
+
+        if (cqe.res < 0) {
+          throw uringError(isWrite ? "Failed writing to output file"
+                                   : "Failed reading input file",
+                           -cqe.res);
+        }
+
+        const size_t done{static_cast<size_t>(cqe.res)};
+
+        if (!isWrite) {
+          // Finish short reads synchronously, then queue the XORed write
+          if (done < slot.len &&
+              readAt(input, slot.data + done, slot.len - done,
+                     slot.offset + done) != slot.len - done) {
+            throw std::runtime_error("Input file shrank while processing.");
+          }
+
+          if (backup) {
+            StageTimer timer{Stage::Backup};
+            writeAt(backup, slot.data, slot.len, slot.offset);
+          }
+
+          xorWithLayout(std::span<char>(slot.data, slot.len), xorkey,
+                        slot.offset, options);
+          ring.push(writeOp, output.get(), slot.data, slot.len, slot.offset,
+                    fixed ? static_cast<int>(index) : -1,
+                    uint64_t{index} * 2 + 1);
+          continue;
+        }
+
+        if (done < slot.len) {
+          writeAt(output, slot.data + done, slot.len - done,
+                  slot.offset + done);
+        }
+
+        cache.release(slot.offset, slot.len, 0, size);
+        --inFlight;
+
+        if (nextRead < size) {
+          startRead(index);
+        }
+      } catch (...) {
+        error = std::current_exception();
+        --inFlight;
+      }
+    }
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  cache.finish(size);
+}
+
+#else
+
+bool uringSupported() {
+  return false;
+}
+
+void processFileUring(const std::string&, const std::string&,
+                      std::string_view, const ProcessOptions&) {
+  throw std::runtime_error("dynoXOR was built without io_uring support.");
+}
+
+#endif
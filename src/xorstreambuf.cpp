@@ -0,0 +1,253 @@
+#include "../include/xorstreambuf.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <span>
+
+XorStreambuf::XorStreambuf(std::streambuf* inner, std::string_view key,
+                           uint64_t keyOffset, size_t bufferSize)
+    : inner_(inner),
+      stream_(key, keyOffset),
+      input_(std::max<size_t>(bufferSize, 1)),
+      output_(std::max<size_t>(bufferSize, 1)) {
+  // Unseekable streams (pipes, sockets) report -1 and keep a zero base.
+  // Buffers with separate positions (stringbuf) refuse a tell of both
+  pos_type start{inner_->pubseekoff(0, std::ios_base::cur, std::ios_base::in)};
+
+  if (start == pos_type(off_type(-1))) {
+    start = inner_->pubseekoff(0, std::ios_base::cur, std::ios_base::out);
+  }
+
+  if (start != pos_type(off_type(-1))) {
+    keyBase_ = static_cast<int64_t>(keyOffset) -
+               static_cast<int64_t>(off_type(start));
+  }
+
+  // Start in neither mode: the first read or write sets up its area
+  setg(input_.data(), input_.data(), input_.data());
+  setp(nullptr, nullptr);
+}
+
+XorStreambuf::~XorStreambuf() {
+  flushOutput();
+}
+
+XorStreambuf::int_type XorStreambuf::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  if (!startReading()) {
+    return traits_type::eof();
+  }
+
+  const std::streamsize count{inner_->sgetn(
+      input_.data(), static_cast<std::streamsize>(input_.size()))};
+
+  if (count <= 0) {
+    setg(input_.data(), input_.data(), input_.data());
+    return traits_type::eof();
+  }
+
+  stream_.apply(std::span<char>(input_.data(), static_cast<size_t>(count)));
+  setg(input_.data(), input_.data(), input_.data() + count);
+
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize XorStreambuf::xsgetn(char* data, std::streamsize count) {
+  std::streamsize done{0};
+
+  while (done < count) {
+    // Serve buffered input first
+    if (gptr() < egptr()) {
+      const std::streamsize len{std::min<std::streamsize>(
+          count - done, static_cast<std::streamsize>(egptr() - gptr()))};
+      std::memcpy(data + done, gptr(), static_cast<size_t>(len));
+      // gbump takes an int, too small for buffers over 2 GiB
+      setg(eback(), gptr() + len, egptr());
+      done += len;
+      continue;
+    }
+
+    // Large reads skip the buffer and are XORed in the caller's memory
+    if (count - done >= static_cast<std::streamsize>(input_.size())) {
+      if (!startReading()) {
+        break;
+      }
+
+      const std::streamsize len{inner_->sgetn(data + done, count - done)};
+
+      if (len <= 0) {
+        break;
+      }
+
+      stream_.apply(std::span<char>(data + done, static_cast<size_t>(len)));
+      done += len;
+      continue;
+    }
+
+    if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+      break;
+    }
+  }
+
+  return done;
+}
+
+XorStreambuf::int_type XorStreambuf::overflow(int_type ch) {
+  // Switching from reading: inner goes back to the reader's position
+  if (!pbase()) {
+    if (!dropInput()) {
+      return traits_type::eof();
+    }
+
+    setp(output_.data(), output_.data() + output_.size());
+  } else if (!flushOutput()) {
+    return traits_type::eof();
+  }
+
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+
+  return traits_type::not_eof(ch);
+}
+
+int XorStreambuf::sync() {
+  if (!flushOutput()) {
+    return -1;
+  }
+
+  return inner_->pubsync();
+}
+
+XorStreambuf::pos_type XorStreambuf::seekoff(off_type offset,
+                                             std::ios_base::seekdir direction,
+                                             std::ios_base::openmode which) {
+  // One position serves reading and writing, while inner may keep two
+  // (stringbuf): a seek of both at once is ambiguous
+  if ((which & std::ios_base::in) && (which & std::ios_base::out)) {
+    return pos_type(off_type(-1));
+  }
+
+  // inner is ahead of the reader by the input still buffered, and behind
+  // the writer by the output not yet flushed
+  const off_type buffered{static_cast<off_type>(pptr() - pbase()) -
+                          static_cast<off_type>(egptr() - gptr())};
+
+  // tellg/tellp: report the position without dropping any buffer
+  if (direction == std::ios_base::cur && offset == 0) {
+    const pos_type position{inner_->pubseekoff(0, direction, which)};
+
+    return position == pos_type(off_type(-1)) ? position
+                                              : position + buffered;
+  }
+
+  if (!flushOutput()) {
+    return pos_type(off_type(-1));
+  }
+
+  // Where inner is, to come back to if the seek is refused; the buffered
+  // input and the key stay as they are until the seek has succeeded
+  const pos_type innerPosition{
+      inner_->pubseekoff(0, std::ios_base::cur, which)};
+
+  if (innerPosition == pos_type(off_type(-1))) {
+    return innerPosition;
+  }
+
+  const off_type unread{egptr() - gptr()};
+
+  if (direction == std::ios_base::cur) {
+    offset -= unread;
+  }
+
+  const pos_type position{inner_->pubseekoff(offset, direction, which)};
+
+  if (position == pos_type(off_type(-1))) {
+    return position;
+  }
+
+  // Bytes before the construction point have no key offset
+  if (keyBase_ + off_type(position) < 0) {
+    inner_->pubseekpos(innerPosition, which);
+
+    return pos_type(off_type(-1));
+  }
+
+  setg(input_.data(), input_.data(), input_.data());
+  setp(nullptr, nullptr);
+  stream_.seek(static_cast<uint64_t>(keyBase_ + off_type(position)));
+
+  return position;
+}
+
+XorStreambuf::pos_type XorStreambuf::seekpos(pos_type position,
+                                             std::ios_base::openmode which) {
+  return seekoff(off_type(position), std::ios_base::beg, which);
+}
+
+bool XorStreambuf::flushOutput() {
+  const size_t pending{static_cast<size_t>(pptr() - pbase())};
+
+  if (!pending) {
+    return true;
+  }
+
+  // The put area is ours, so it is XORed in place before it is handed over;
+  // a tail left by a short write is XORed already
+  stream_.apply(std::span<char>(pbase() + encoded_, pending - encoded_));
+  const size_t written{static_cast<size_t>(std::max<std::streamsize>(
+      inner_->sputn(pbase(), static_cast<std::streamsize>(pending)), 0))};
+  setp(output_.data(), output_.data() + output_.size());
+
+  if (written == pending) {
+    encoded_ = 0;
+    return true;
+  }
+
+  // Keep what inner refused for the next flush, so the key stays in step
+  // with the bytes inner actually holds
+  encoded_ = pending - written;
+  std::memmove(output_.data(), output_.data() + written, encoded_);
+
+  // pbump takes an int, too small for buffers over 2 GiB
+  for (size_t left{encoded_}; left;) {
+    const size_t step{std::min<size_t>(left, INT_MAX)};
+    pbump(static_cast<int>(step));
+    left -= step;
+  }
+
+  return false;
+}
+
+bool XorStreambuf::startReading() {
+  if (!flushOutput()) {
+    return false;
+  }
+
+  setp(nullptr, nullptr);
+
+  return true;
+}
+
+bool XorStreambuf::dropInput() {
+  const off_type unread{egptr() - gptr()};
+
+  if (unread) {
+    // An unseekable inner cannot go back: the input stays readable, and the
+    // write is refused
+    if (inner_->pubseekoff(-unread, std::ios_base::cur, std::ios_base::in) ==
+        pos_type(off_type(-1))) {
+      return false;
+    }
+
+    stream_.seek(stream_.offset() - static_cast<uint64_t>(unread));
+  }
+
+  setg(input_.data(), input_.data(), input_.data());
+
+  return true;
+}
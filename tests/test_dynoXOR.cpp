@@ -1,12 +1,41 @@
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <ios>
+#include <iostream>
 #include <iterator>
+#include <optional>
+#include <span>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 #include "../externals/Catch2/src/catch2/catch_test_macros.hpp"
+#include "../include/backends.hpp"
+#include "../include/batch.hpp"
+#include "../include/buffers.hpp"
 #include "../include/constants.hpp"
+#include "../include/dynoxor.hpp"
+#include "../include/fileio.hpp"
 #include "../include/functions.hpp"
+#include "../include/inplace.hpp"
+#include "../include/kernels.hpp"
+#include "../include/keyfile.hpp"
+#include "../include/perfcounters.hpp"
+#include "../include/profile.hpp"
+#include "../include/stats.hpp"
+#include "../include/tuning.hpp"
+#include "../include/xorstreambuf.hpp"
+
+#ifdef DYNOXOR_POSIX_IO
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <csignal>
+#endif
 
 // Helper function that creates temporary test file
 void createTestFile(const std::string& filename, const std::string& content) {
@@ -30,6 +59,38 @@ void cleanupTestFile(const std::string& filename) {
   }
 }
 
+#ifdef DYNOXOR_POSIX_IO
+// Header (magic, settings) of the journal a journaled in-place run writes for
+// file. The run is stopped while writing its first record by a file size
+// limit, as on a full disk, before the file is modified
+std::string journalHeader(const std::string& file, const std::string& key) {
+  rlimit previous{};
+  REQUIRE(::getrlimit(RLIMIT_FSIZE, &previous) == 0);
+  rlimit limited{previous};
+  limited.rlim_cur = 1024 * 1024;
+  // Writes past the limit then fail with EFBIG instead of killing the process
+  const auto handler{std::signal(SIGXFSZ, SIG_IGN)};
+  REQUIRE(::setrlimit(RLIMIT_FSIZE, &limited) == 0);
+  bool failed{false};
+
+  try {
+    processFileInPlace(file, key, ProcessOptions{.journal = true});
+  } catch (const std::runtime_error&) {
+    failed = true;
+  }
+
+  ::setrlimit(RLIMIT_FSIZE, &previous);
+  std::signal(SIGXFSZ, handler);
+  REQUIRE(failed);
+
+  const std::string tempFile{file + ".journal.tmp"};
+  const std::string header{readTestFile(tempFile).substr(0, 16)};
+  cleanupTestFile(tempFile);
+
+  return header;
+}
+#endif
+
 // TEST: getConfigDir()
 
 TEST_CASE("getConfigDir returns valid path", "[config]") {
@@ -70,6 +131,10 @@ TEST_CASE("verifyFile() validates file existence and content",
     cleanupTestFile(testFile);
   }
 
+  SECTION("Accepts standard input") {
+    REQUIRE_NOTHROW(verifyFile("-"));
+  }
+
   SECTION("Succeeds for valid non-empty files") {
     createTestFile(testFile, "Some content");
     REQUIRE_NOTHROW(verifyFile(testFile));
@@ -174,9 +239,12 @@ TEST_CASE("backupFile creates backup copies", "[file][backup]") {
   SECTION("Creates backup with same content") {
     createTestFile(testFile, content);
 
-    REQUIRE_NOTHROW(backupFile(testFile));
+    BackupMethod method{};
+    REQUIRE_NOTHROW(method = backupFile(testFile));
     REQUIRE(std::filesystem::exists(backedUpFile));
 
+    REQUIRE_FALSE(backupMethodName(method).empty());
+
     std::string originalContent{readTestFile(testFile)};
     std::string backupContent{readTestFile(backedUpFile)};
 
@@ -187,6 +255,106 @@ TEST_CASE("backupFile creates backup copies", "[file][backup]") {
   }
 }
 
+// TEST: transformFileWithBackup()
+
+TEST_CASE("transformFileWithBackup backs up while processing",
+          "[file][backup]") {
+  const std::string testFile{"test_fused.bin"};
+  const std::string backedUpFile{testFile + ".bak"};
+  const std::string expectedFile{"test_fused_expected.bin"};
+  const std::string key{"SecretKey123456789"};
+  std::string data;
+
+  for (int i{0}; i < 50000; ++i) {
+    data += static_cast<char>(i * 29);
+  }
+
+  createTestFile(testFile, data);
+  processFileInChunks(testFile, expectedFile, key);
+  const std::string expected{readTestFile(expectedFile)};
+
+  SECTION("Every engine leaves an exact backup and the XORed output") {
+    const std::string outputFile{"test_fused_output.bin"};
+
+    // The output is another file, so each engine writes the backup itself
+    // (unless the filesystem clones it)
+    for (ProcessOptions options :
+         {ProcessOptions{}, ProcessOptions{.threads = 3},
+          ProcessOptions{.ioBackend = IoBackend::Posix},
+          ProcessOptions{.ioBackend = IoBackend::Uring},
+          ProcessOptions{.pipelineWorkers = 2}}) {
+      cleanupTestFile(backedUpFile);
+      options.chunkSize = 4096;
+
+      BackupMethod method{
+          transformFileWithBackup(testFile, outputFile, key, options)};
+
+      REQUIRE((method == BackupMethod::Fused ||
+               method == BackupMethod::Reflink));
+      REQUIRE(readTestFile(backedUpFile) == data);
+      REQUIRE(readTestFile(outputFile) == expected);
+      REQUIRE(readTestFile(testFile) == data);
+    }
+
+    cleanupTestFile(outputFile);
+  }
+
+  SECTION("Overwrites back up the whole file before modifying it") {
+    for (ProcessOptions options :
+         {ProcessOptions{}, ProcessOptions{.threads = 3, .journal = false}}) {
+      createTestFile(testFile, data);
+
+      BackupMethod method{
+          transformFileWithBackup(testFile, testFile, key, options)};
+
+      REQUIRE(method != BackupMethod::Fused);
+      REQUIRE(readTestFile(backedUpFile) == data);
+      REQUIRE(readTestFile(testFile) == expected);
+    }
+  }
+
+#ifdef __linux__
+  SECTION("A resumed run backs up the whole file as it was on disk") {
+    // Interrupted halfway through the second 4 MiB window of a journaled run
+    const size_t window{4 * 1024 * 1024};
+    std::string large(3 * window, '\0');
+
+    for (size_t i{0}; i < large.size(); ++i) {
+      large[i] = static_cast<char>(i * 31 + (i >> 12));
+    }
+
+    createTestFile(testFile, large);
+    processFileInChunks(testFile, expectedFile, key);
+    const std::string done{readTestFile(expectedFile)};
+
+    // A genuine journal header (magic, settings) from a failing run
+    const std::string journalFile{testFile + ".journal"};
+    std::string record{journalHeader(testFile, key)};
+    REQUIRE(readTestFile(testFile) == large);
+    const uint64_t range[2]{window, window};
+    record.append(reinterpret_cast<const char*>(range), sizeof(range));
+    record += large.substr(window, window);
+    createTestFile(journalFile, record);
+
+    const std::string torn{done.substr(0, window + window / 2) +
+                           large.substr(window + window / 2)};
+    createTestFile(testFile, torn);
+
+    BackupMethod method{
+        transformFileWithBackup(testFile, testFile, key, ProcessOptions{})};
+
+    REQUIRE(method != BackupMethod::Fused);
+    REQUIRE(readTestFile(backedUpFile) == torn);
+    REQUIRE(readTestFile(testFile) == done);
+    REQUIRE_FALSE(std::filesystem::exists(journalFile));
+  }
+#endif
+
+  cleanupTestFile(testFile);
+  cleanupTestFile(backedUpFile);
+  cleanupTestFile(expectedFile);
+}
+
 // TEST: processFileInChunks
 
 TEST_CASE("processFileInChunks performs XOR encryption", "[xor][processing]") {
@@ -239,6 +407,139 @@ TEST_CASE("processFileInChunks performs XOR encryption", "[xor][processing]") {
     cleanupTestFile(decryptedFile);
   }
 
+  SECTION("Output does not depend on the chunk size") {
+    createTestFile(inputFile, testData);
+    std::string smallChunksFile{"test_small_chunks.bin"};
+
+    processFileInChunks(inputFile, outputFile, key, 1024);
+    processFileInChunks(inputFile, smallChunksFile, key, 5);
+
+    REQUIRE(readTestFile(outputFile) == readTestFile(smallChunksFile));
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+    cleanupTestFile(smallChunksFile);
+  }
+
+  SECTION("Legacy key phase restarts the key every chunk") {
+    createTestFile(inputFile, testData);
+    ProcessOptions options{.chunkSize = 5, .legacyKeyPhase = true};
+
+    processFileInChunks(inputFile, outputFile, key, options);
+    std::string encryptedData{readTestFile(outputFile)};
+
+    for (size_t i{0}; i < testData.size(); ++i) {
+      REQUIRE(encryptedData[i] == static_cast<char>(testData[i] ^ key[i % 5]));
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+  }
+
+  SECTION("Multi-threaded processing matches a sequential run") {
+    std::string largeData;
+
+    for (int i{0}; i < 100000; ++i) {
+      largeData += static_cast<char>(i * 31);
+    }
+
+    createTestFile(inputFile, largeData);
+    std::string parallelFile{"test_parallel.bin"};
+
+    for (bool legacy : {false, true}) {
+      processFileInChunks(inputFile, outputFile, key,
+                          ProcessOptions{.chunkSize = 1000,
+                                         .legacyKeyPhase = legacy});
+      processFileInChunks(inputFile, parallelFile, key,
+                          ProcessOptions{.chunkSize = 1000,
+                                         .legacyKeyPhase = legacy,
+                                         .threads = 4});
+
+      REQUIRE(readTestFile(parallelFile) == readTestFile(outputFile));
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+    cleanupTestFile(parallelFile);
+  }
+
+  SECTION("Every I/O backend produces identical output") {
+    std::string largeData;
+
+    for (int i{0}; i < 100000; ++i) {
+      largeData += static_cast<char>(i * 17);
+    }
+
+    createTestFile(inputFile, largeData);
+    processFileInChunks(inputFile, outputFile, key, 1000);
+    std::string backendFile{"test_backend.bin"};
+
+    for (const char* name : {"stream", "posix", "uring"}) {
+      processFileInChunks(inputFile, backendFile, key,
+                          ProcessOptions{.chunkSize = 1000,
+                                         .ioBackend = parseIoBackend(name),
+                                         .queueDepth = 4});
+
+      REQUIRE(readTestFile(backendFile) == readTestFile(outputFile));
+    }
+
+    REQUIRE_THROWS_AS(parseIoBackend("aio"), std::runtime_error);
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+    cleanupTestFile(backendFile);
+  }
+
+  SECTION("Pipelined processing preserves output order") {
+    std::string largeData;
+
+    for (int i{0}; i < 100000; ++i) {
+      largeData += static_cast<char>(i * 19);
+    }
+
+    createTestFile(inputFile, largeData);
+    processFileInChunks(inputFile, outputFile, key, 1000);
+    std::string pipelineFile{"test_pipeline.bin"};
+
+    for (unsigned workers : {1u, 3u}) {
+      processFileInChunks(inputFile, pipelineFile, key,
+                          ProcessOptions{.chunkSize = 1000,
+                                         .pipelineWorkers = workers});
+
+      REQUIRE(readTestFile(pipelineFile) == readTestFile(outputFile));
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+    cleanupTestFile(pipelineFile);
+  }
+
+  SECTION("Direct I/O handles unaligned chunks and tails") {
+    std::string largeData;
+
+    for (int i{0}; i < 100001; ++i) {
+      largeData += static_cast<char>(i * 23);
+    }
+
+    createTestFile(inputFile, largeData);
+    processFileInChunks(inputFile, outputFile, key, 1000);
+    std::string directFile{"test_direct.bin"};
+
+    // Chunk sizes are rounded up to the block size under O_DIRECT
+    for (unsigned threads : {1u, 3u}) {
+      processFileInChunks(inputFile, directFile, key,
+                          ProcessOptions{.chunkSize = 5000,
+                                         .threads = threads,
+                                         .direct = true});
+
+      REQUIRE(readTestFile(directFile) == readTestFile(outputFile));
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+    cleanupTestFile(directFile);
+  }
+
   SECTION("Handles binary data correctly") {
     // Create binary test data
     std::string binaryData;
@@ -263,6 +564,463 @@ TEST_CASE("processFileInChunks performs XOR encryption", "[xor][processing]") {
   }
 }
 
+// TEST: processFileInPlace()
+
+TEST_CASE("processFileInPlace overwrites files without a copy",
+          "[xor][inplace]") {
+  const std::string inputFile{"test_inplace.bin"};
+  const std::string outputFile{"test_inplace_expected.bin"};
+  const std::string journalFile{inputFile + ".journal"};
+  const std::string key{"SecretKey123456789"};
+  std::string data;
+
+  for (int i{0}; i < 100000; ++i) {
+    data += static_cast<char>(i * 13);
+  }
+
+  SECTION("Matches out-of-place processing and is reversible") {
+    for (bool journal : {false, true}) {
+      createTestFile(inputFile, data);
+      processFileInChunks(inputFile, outputFile, key);
+
+      ProcessOptions options{.journal = journal};
+      processFileInPlace(inputFile, key, options);
+      REQUIRE(readTestFile(inputFile) == readTestFile(outputFile));
+      REQUIRE_FALSE(std::filesystem::exists(journalFile));
+
+      processFileInPlace(inputFile, key, options);
+      REQUIRE(readTestFile(inputFile) == data);
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+  }
+
+#ifdef DYNOXOR_POSIX_IO
+  SECTION("Overwrite runs on several threads stay in place") {
+    std::string large(9 * 1024 * 1024 + 321, '\0');
+
+    for (size_t i{0}; i < large.size(); ++i) {
+      large[i] = static_cast<char>(i * 7 + (i >> 11));
+    }
+
+    createTestFile(inputFile, large);
+    processFileInChunks(inputFile, outputFile, key);
+    const std::string expected{readTestFile(outputFile)};
+
+    for (bool journal : {false, true}) {
+      createTestFile(inputFile, large);
+      struct stat before{};
+      REQUIRE(::stat(inputFile.c_str(), &before) == 0);
+
+      transformFile(inputFile, inputFile, key,
+                    ProcessOptions{.threads = 4, .journal = journal});
+      REQUIRE(readTestFile(inputFile) == expected);
+      REQUIRE_FALSE(std::filesystem::exists(inputFile + ".tmp"));
+      REQUIRE_FALSE(std::filesystem::exists(journalFile));
+
+      // A temporary copy renamed over the input would be a new inode
+      struct stat after{};
+      REQUIRE(::stat(inputFile.c_str(), &after) == 0);
+      REQUIRE(after.st_ino == before.st_ino);
+    }
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+  }
+
+  // Root may write any file, so only other users can see the fallback
+  if (::geteuid() != 0) {
+    SECTION("Read-only files are replaced through a rename") {
+      createTestFile(inputFile, data);
+      processFileInChunks(inputFile, outputFile, key);
+      std::filesystem::permissions(inputFile,
+                                   std::filesystem::perms::owner_read |
+                                       std::filesystem::perms::group_read);
+      struct stat before{};
+      REQUIRE(::stat(inputFile.c_str(), &before) == 0);
+
+      transformFile(inputFile, inputFile, key, ProcessOptions{});
+      REQUIRE(readTestFile(inputFile) == readTestFile(outputFile));
+      REQUIRE_FALSE(std::filesystem::exists(inputFile + ".tmp"));
+
+      // A new inode: the temporary copy was renamed over the input
+      struct stat after{};
+      REQUIRE(::stat(inputFile.c_str(), &after) == 0);
+      REQUIRE(after.st_ino != before.st_ino);
+
+      cleanupTestFile(inputFile);
+      cleanupTestFile(outputFile);
+    }
+  }
+#endif
+
+#ifdef __linux__
+  SECTION("Resumes an interrupted run from its journal") {
+    // Two journaled windows (4 MiB each) and a partial third
+    std::string large(10 * 1024 * 1024 + 123, '\0');
+
+    for (size_t i{0}; i < large.size(); ++i) {
+      large[i] = static_cast<char>(i * 31 + (i >> 12));
+    }
+
+    createTestFile(inputFile, large);
+    processFileInChunks(inputFile, outputFile, key);
+    const std::string expected{readTestFile(outputFile)};
+
+    // A run stopped while journaling its first window left the file as is
+    const std::string header{journalHeader(inputFile, key)};
+    REQUIRE(readTestFile(inputFile) == large);
+    REQUIRE_FALSE(std::filesystem::exists(journalFile));
+
+    // Interrupted before the first window was modified
+    const size_t window{4 * 1024 * 1024};
+    std::string first{header};
+    const uint64_t firstRange[2]{0, window};
+    first.append(reinterpret_cast<const char*>(firstRange), sizeof(firstRange));
+    first += large.substr(0, window);
+    createTestFile(journalFile, first);
+
+    processFileInPlace(inputFile, key, ProcessOptions{.journal = true});
+    REQUIRE(readTestFile(inputFile) == expected);
+    REQUIRE_FALSE(std::filesystem::exists(journalFile));
+
+    // Interrupted halfway through the second window: the first is done, the
+    // second torn, and the journal holds its original bytes
+    std::string torn{expected.substr(0, window + window / 2) +
+                     large.substr(window + window / 2)};
+    createTestFile(inputFile, torn);
+
+    // Same header (magic, settings), pointing at the second window
+    std::string record{header};
+    const uint64_t range[2]{window, window};
+    record.append(reinterpret_cast<const char*>(range), sizeof(range));
+    record += large.substr(window, window);
+    createTestFile(journalFile, record);
+
+    processFileInPlace(inputFile, key, ProcessOptions{.journal = true});
+    REQUIRE(readTestFile(inputFile) == expected);
+    REQUIRE_FALSE(std::filesystem::exists(journalFile));
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(outputFile);
+  }
+#endif
+
+  SECTION("Refuses to replay a corrupt journal") {
+    createTestFile(inputFile, data);
+    createTestFile(journalFile, "not a journal");
+
+    REQUIRE_THROWS_AS(processFileInPlace(inputFile, key, ProcessOptions{}),
+                      std::runtime_error);
+    REQUIRE(readTestFile(inputFile) == data);
+
+    cleanupTestFile(inputFile);
+    cleanupTestFile(journalFile);
+  }
+}
+
+// TEST: processStreamInChunks()
+
+#ifdef DYNOXOR_POSIX_IO
+TEST_CASE("Streams from standard input to a pipe on standard output",
+          "[xor][stream]") {
+  const std::string inputFile{"test_stream.bin"};
+  const std::string outputFile{"test_stream_expected.bin"};
+  const std::string key{"SecretKey123456789"};
+  std::string data;
+
+  for (int i{0}; i < 3000000; ++i) {
+    data += static_cast<char>(i * 23);
+  }
+
+  createTestFile(inputFile, data);
+  processFileInChunks(inputFile, outputFile, key);
+  const std::string backupName{inputFile + ".bak"};
+
+  // Spliced and pipelined output with a fused backup, then -b with "-o -"
+  for (int run{0}; run < 3; ++run) {
+    // A stale backup must be replaced, not kept or truncated
+    createTestFile(backupName, "previous backup");
+
+    // Point stdin at the file and stdout at a pipe drained by a thread
+    int pipeFds[2];
+    REQUIRE(::pipe(pipeFds) == 0);
+    std::cout.flush();
+    const int savedStdin{::dup(STDIN_FILENO)};
+    const int savedStdout{::dup(STDOUT_FILENO)};
+    FileHandle input{openInputFile(inputFile)};
+    ::dup2(input.get(), STDIN_FILENO);
+    ::dup2(pipeFds[1], STDOUT_FILENO);
+    ::close(pipeFds[1]);
+
+    std::string streamed;
+    std::thread drain{[&] {
+      char chunk[65536];
+      ssize_t n{0};
+
+      while ((n = ::read(pipeFds[0], chunk, sizeof(chunk))) > 0) {
+        streamed.append(chunk, static_cast<size_t>(n));
+      }
+    }};
+
+    if (run < 2) {
+      processFileInChunks("-", "-", key,
+                          ProcessOptions{.pipelineWorkers = run * 2u,
+                                         .backupPath = backupName});
+    } else {
+      transformFileWithBackup(inputFile, "-", key, ProcessOptions{});
+    }
+
+    ::dup2(savedStdin, STDIN_FILENO);
+    ::dup2(savedStdout, STDOUT_FILENO);
+    ::close(savedStdin);
+    ::close(savedStdout);
+    drain.join();
+    ::close(pipeFds[0]);
+
+    REQUIRE(streamed == readTestFile(outputFile));
+    REQUIRE(readTestFile(backupName) == data);
+  }
+
+  cleanupTestFile(inputFile);
+  cleanupTestFile(outputFile);
+  cleanupTestFile(backupName);
+}
+#endif
+
+// TEST: collectBatchJobs() / runBatch()
+
+TEST_CASE("Batch mode processes many files and collects errors",
+          "[xor][batch]") {
+  const std::string inputDir{"test_batch_in"};
+  const std::string outputDir{"test_batch_out"};
+  const std::string key{"SecretKey123456789"};
+
+  std::filesystem::create_directories(inputDir + "/nested");
+  createTestFile(inputDir + "/small.txt", "tiny");
+  createTestFile(inputDir + "/nested/large.txt", std::string(5000, 'x'));
+  createTestFile(inputDir + "/empty.txt", "");
+
+  SECTION("Directories are expanded largest file first") {
+    std::vector<BatchJob> jobs{
+        collectBatchJobs({inputDir, "missing.txt"}, outputDir)};
+
+    REQUIRE(jobs.size() == 3);
+    REQUIRE(jobs[0].input.find("large.txt") != std::string::npos);
+    REQUIRE(jobs[0].output ==
+            (std::filesystem::path(outputDir) / "nested" / "large.txt")
+                .string());
+    REQUIRE(jobs[2].input == "missing.txt");
+  }
+
+  SECTION("Failures are reported without stopping the batch") {
+    std::vector<BatchJob> jobs{
+        collectBatchJobs({inputDir, "missing.txt"}, outputDir)};
+    std::vector<BatchFailure> failures{
+        runBatch(jobs, key, ProcessOptions{}, BatchOptions{.jobs = 2})};
+
+    REQUIRE(failures.size() == 1);
+    REQUIRE(failures[0].input == "missing.txt");
+
+    std::string decrypted{"test_batch_small.txt"};
+    processFileInChunks(outputDir + "/small.txt", decrypted, key);
+    REQUIRE(readTestFile(decrypted) == "tiny");
+    cleanupTestFile(decrypted);
+  }
+
+  SECTION("Shared outputs fail and work files are skipped") {
+    std::filesystem::create_directories(inputDir + "/other");
+    createTestFile(inputDir + "/other/small.txt", "other");
+    createTestFile(inputDir + "/nested/large.txt.bak", "backup");
+    createTestFile(inputDir + "/nested/large.txt.journal", "journal");
+    createTestFile(inputDir + "/nested/large.txt.calibrate.tmp", "sample");
+
+    std::vector<BatchJob> jobs{collectBatchJobs(
+        {inputDir + "/small.txt", inputDir + "/other/small.txt", inputDir},
+        outputDir)};
+    // Three inputs write small.txt; the walk adds other/ and nested/ files
+    REQUIRE(jobs.size() == 5);
+
+    std::vector<BatchFailure> failures{
+        runBatch(jobs, key, ProcessOptions{}, BatchOptions{.jobs = 2})};
+
+    REQUIRE(failures.size() == 3);
+
+    for (const BatchFailure& failure : failures) {
+      REQUIRE(failure.error.find("shared") != std::string::npos);
+    }
+
+    REQUIRE_FALSE(std::filesystem::exists(outputDir + "/small.txt"));
+    REQUIRE(std::filesystem::exists(outputDir + "/other/small.txt"));
+  }
+
+  SECTION("User files sharing a work file extension are processed") {
+    // No notes or data file next to them, so they are not this tool's
+    createTestFile(inputDir + "/notes.bak", "notes");
+    createTestFile(inputDir + "/data.tmp", "data");
+    createTestFile(inputDir + "/log.journal", "log");
+
+    std::vector<BatchJob> jobs{collectBatchJobs({inputDir}, outputDir)};
+    REQUIRE(jobs.size() == 5);
+  }
+
+#ifdef DYNOXOR_POSIX_IO
+  SECTION("Links to one file are never processed twice") {
+    const std::string small{inputDir + "/small.txt"};
+    std::filesystem::create_symlink("small.txt", inputDir + "/symlink.txt");
+    std::filesystem::create_hard_link(small, inputDir + "/hardlink.txt");
+
+    // Overwritten in place, each name would XOR the same file again
+    std::vector<BatchJob> jobs{collectBatchJobs(
+        {small, inputDir + "/symlink.txt", inputDir + "/hardlink.txt",
+         inputDir + "/nested/large.txt"},
+        "")};
+    std::vector<BatchFailure> failures{
+        runBatch(jobs, key, ProcessOptions{}, BatchOptions{.jobs = 2})};
+
+    REQUIRE(failures.size() == 3);
+
+    for (const BatchFailure& failure : failures) {
+      REQUIRE(failure.error.find("shared") != std::string::npos);
+    }
+
+    REQUIRE(readTestFile(small) == "tiny");
+
+    // An output that is another job's input, under another name
+    createTestFile(inputDir + "/nested/small.txt", "copy");
+    jobs = collectBatchJobs(
+        {inputDir + "/nested/small.txt", inputDir + "/symlink.txt"}, inputDir);
+    REQUIRE(jobs.size() == 2);
+    REQUIRE(jobs[0].error.find("shared") != std::string::npos);
+    REQUIRE(jobs[1].error.find("shared") != std::string::npos);
+  }
+
+  SECTION("Files vanishing during the walk fail on their own") {
+    // A link whose target is gone is listed, then fails to stat, just like a
+    // file deleted between the directory read and the size lookup
+    createTestFile(inputDir + "/nested/gone.txt", "deleted");
+    std::filesystem::create_symlink("gone.txt", inputDir + "/nested/link.txt");
+    std::filesystem::remove(inputDir + "/nested/gone.txt");
+
+    std::vector<BatchJob> jobs;
+    REQUIRE_NOTHROW(jobs = collectBatchJobs({inputDir}, outputDir));
+    REQUIRE(jobs.size() == 3);
+
+    std::vector<BatchFailure> failures{
+        runBatch(jobs, key, ProcessOptions{}, BatchOptions{.jobs = 2})};
+
+    REQUIRE(failures.size() == 1);
+    REQUIRE(failures[0].input.find("link.txt") != std::string::npos);
+    REQUIRE(std::filesystem::exists(outputDir + "/small.txt"));
+    REQUIRE(std::filesystem::exists(outputDir + "/nested/large.txt"));
+  }
+#endif
+
+  std::filesystem::remove_all(inputDir);
+  std::filesystem::remove_all(outputDir);
+}
+
+// TEST: parseChunkSize() / autoChunkSize()
+
+TEST_CASE("Chunk sizes are parsed and tuned per file", "[tuning]") {
+  SECTION("Sizes accept binary suffixes and auto") {
+    REQUIRE(parseChunkSize("4096") == 4096);
+    REQUIRE(parseChunkSize("64K") == 64 * 1024);
+    REQUIRE(parseChunkSize("2m") == 2 * 1024 * 1024);
+    REQUIRE(parseChunkSize("auto") == 0);
+
+    for (const char* invalid :
+         {"", "0", "K", "12Q", "-4K", "2G", "99999999999G"}) {
+      REQUIRE_THROWS_AS(parseChunkSize(invalid), std::runtime_error);
+    }
+  }
+
+  SECTION("Auto picks a block-aligned size, one chunk for small files") {
+    const std::string smallFile{"test_tuning_small.bin"};
+    const std::string largeFile{"test_tuning_large.bin"};
+    createTestFile(smallFile, std::string(10000, 'x'));
+    createTestFile(largeFile, std::string(16 * 1024 * 1024, 'y'));
+
+    const size_t small{autoChunkSize(smallFile)};
+    const size_t large{autoChunkSize(largeFile)};
+
+    REQUIRE(small >= 10000);
+    REQUIRE(small < 64 * 1024);
+    REQUIRE(large >= 64 * 1024);
+    REQUIRE(large % 4096 == 0);
+    REQUIRE(autoChunkSize(Constants::streamPath) == Constants::chunkSize);
+    REQUIRE_FALSE(storageKindName(probeStorage(largeFile).kind).empty());
+
+    cleanupTestFile(smallFile);
+    cleanupTestFile(largeFile);
+  }
+}
+
+// TEST: saveProfile() / loadProfile()
+
+TEST_CASE("Tuning profiles are stored per volume", "[tuning][profile]") {
+  const std::string profileFile{"test_profiles.conf"};
+  cleanupTestFile(profileFile);
+
+  SECTION("Saving replaces only the entry of the same volume") {
+    const std::string data{"uuid:7@/data"};
+    const std::string other{"uuid:9@/data"};
+
+    saveProfile(profileFile, TuningProfile{.volume = data, .threads = 2});
+    saveProfile(profileFile,
+                TuningProfile{.volume = other,
+                              .chunkSize = 1024 * 1024,
+                              .ioBackend = IoBackend::Posix,
+                              .kernel = "scalar"});
+    saveProfile(profileFile, TuningProfile{.volume = data, .threads = 4});
+
+    std::optional<TuningProfile> first{loadProfile(profileFile, data)};
+    std::optional<TuningProfile> second{loadProfile(profileFile, other)};
+
+    REQUIRE(first);
+    REQUIRE(first->threads == 4);
+    REQUIRE(second);
+    REQUIRE(second->chunkSize == 1024 * 1024);
+    REQUIRE(second->ioBackend == IoBackend::Posix);
+    REQUIRE(second->kernel == "scalar");
+    REQUIRE_FALSE(loadProfile(profileFile, "uuid:7@/mnt"));
+  }
+
+  SECTION("Damaged lines are skipped") {
+    createTestFile(profileFile,
+                   "volume=sda1@/ chunk=lots\ngarbage\n"
+                   "volume=sda1@/ chunk=64K threads=3 future=1\n");
+
+    std::optional<TuningProfile> profile{loadProfile(profileFile, "sda1@/")};
+
+    REQUIRE(profile);
+    REQUIRE(profile->chunkSize == 64 * 1024);
+    REQUIRE(profile->threads == 3);
+    REQUIRE_FALSE(loadProfile("test_missing_profiles.conf", "sda1@/"));
+  }
+
+  SECTION("Entries keyed on a device number alone are ignored") {
+    createTestFile(profileFile, "device=2049 chunk=1M threads=8\n");
+
+    REQUIRE_FALSE(loadProfile(profileFile, "dev:2049"));
+    REQUIRE_FALSE(loadProfile(profileFile, ""));
+  }
+
+#ifdef DYNOXOR_POSIX_IO
+  SECTION("Files on one filesystem share a persistent volume name") {
+    createTestFile(profileFile, "x");
+    const StorageInfo info{probeStorage(profileFile)};
+
+    REQUIRE_FALSE(info.volume.empty());
+    REQUIRE(info.volume.find(' ') == std::string::npos);
+    REQUIRE(probeStorage(".").volume == info.volume);
+  }
+#endif
+
+  cleanupTestFile(profileFile);
+}
+
 // TEST: logKey()
 
 TEST_CASE("logKey writes keys to log file", "[logging]") {
@@ -287,3 +1045,629 @@ TEST_CASE("logKey writes keys to log file", "[logging]") {
     REQUIRE(logContent.find(testKey) != std::string::npos);
   }
 }
+
+// TEST: acquireBuffer()
+
+TEST_CASE("Buffer pool hands out aligned, reusable buffers", "[buffers]") {
+  SECTION("Buffers are page-aligned and at least the requested size") {
+    for (size_t size : {size_t{0}, size_t{1}, size_t{4097}, size_t{65536}}) {
+      IoBuffer buffer{acquireBuffer(size)};
+
+      REQUIRE(buffer.size() >= std::max<size_t>(size, 1));
+      REQUIRE(reinterpret_cast<uintptr_t>(buffer.data()) % 4096 == 0);
+    }
+  }
+
+  SECTION("A returned buffer is reused for the next request") {
+    char* first{nullptr};
+
+    {
+      IoBuffer buffer{acquireBuffer(12345)};
+      first = buffer.data();
+    }
+
+    IoBuffer again{acquireBuffer(12345)};
+    REQUIRE(again.data() == first);
+  }
+
+  SECTION("Huge page modes fall back to regular pages when unavailable") {
+    REQUIRE_THROWS_AS(parseHugePages("gigantic"), std::runtime_error);
+
+    for (const char* mode : {"transparent", "explicit", "off"}) {
+      setHugePages(parseHugePages(mode));
+      IoBuffer buffer{acquireBuffer(3 * 1024 * 1024)};
+      buffer.data()[buffer.size() - 1] = 'x';
+
+      REQUIRE(buffer.size() == 3 * 1024 * 1024);
+    }
+  }
+}
+
+// TEST: enableStats() / collectStats()
+
+TEST_CASE("Statistics count bytes, stages and system calls", "[stats]") {
+  const std::string inputFile{"test_stats_input.bin"};
+  const std::string outputFile{"test_stats_output.bin"};
+  const std::string key{"StatisticsKey1234"};
+  createTestFile(inputFile, std::string(300000, 's'));
+
+  SECTION("Nothing is collected while statistics are off") {
+    enableStats(false);
+    resetStats();
+    processFileInChunks(inputFile, outputFile, key);
+
+    REQUIRE(collectStats(1.0).bytes == 0);
+  }
+
+  SECTION("A run reports its bytes, reads, XOR and writes") {
+    enableStats(true);
+    resetStats();
+    processFileInChunks(inputFile, outputFile, key,
+                        ProcessOptions{.ioBackend = IoBackend::Posix});
+    const RunStats stats{collectStats(0.5)};
+    enableStats(false);
+
+    REQUIRE(stats.bytes == 300000);
+    REQUIRE(stats.syscalls[static_cast<size_t>(Stage::Read)] >= 5);
+    REQUIRE(stats.syscalls[static_cast<size_t>(Stage::Write)] >= 5);
+    REQUIRE(stats.syscalls[static_cast<size_t>(Stage::Xor)] == 0);
+    REQUIRE(stats.stageSeconds[static_cast<size_t>(Stage::Xor)] > 0);
+
+    const std::string json{formatStatsJson(stats)};
+    REQUIRE(json.find("\"bytes\": 300000") != std::string::npos);
+    REQUIRE(json.find("\"rename\": {") != std::string::npos);
+    REQUIRE(formatStats(stats).find("Throughput") != std::string::npos);
+  }
+
+  SECTION("Nested timers are recorded once, for the outer stage") {
+    enableStats(true);
+    resetStats();
+
+    {
+      StageTimer backup{Stage::Backup};
+      StageTimer write{Stage::Write};
+      countSyscall();
+    }
+
+    const RunStats stats{collectStats(0)};
+    enableStats(false);
+
+    REQUIRE(stats.syscalls[static_cast<size_t>(Stage::Backup)] == 1);
+    REQUIRE(stats.syscalls[static_cast<size_t>(Stage::Write)] == 0);
+    REQUIRE(stats.stageSeconds[static_cast<size_t>(Stage::Write)] == 0);
+  }
+
+  cleanupTestFile(inputFile);
+  cleanupTestFile(outputFile);
+}
+
+// TEST: enablePerfCounters() / collectPerfCounters()
+
+TEST_CASE("Hardware counters are optional", "[stats][perf]") {
+  const std::string inputFile{"test_perf_input.bin"};
+  const std::string outputFile{"test_perf_output.bin"};
+  const std::string key{"PerfCountersKey123"};
+  const std::string content(200000, 'p');
+  createTestFile(inputFile, content);
+
+  SECTION("Processing works whether or not counters can be opened") {
+    enablePerfCounters(true);
+    processFileInChunks(inputFile, outputFile, key);
+    processFileInChunks(outputFile, inputFile, key);
+    const PerfCounts counts{collectPerfCounters()};
+    enablePerfCounters(false);
+
+    REQUIRE(readTestFile(inputFile) == content);
+
+    // Denied or missing counters come with a reason instead of numbers
+    if (counts.available) {
+      REQUIRE(counts.bytes >= 400000);
+    } else {
+      REQUIRE_FALSE(counts.reason.empty());
+    }
+
+    REQUIRE_FALSE(formatPerfCounters(counts).empty());
+  }
+
+  SECTION("Reports give counts per byte") {
+    PerfCounts counts;
+    counts.available = true;
+    counts.bytes = 1000;
+    counts.cycles = 500;
+    counts.instructions = 1000;
+    counts.hasCycles = true;
+    counts.hasInstructions = true;
+
+    const std::string report{formatPerfCounters(counts)};
+    REQUIRE(report.find("cycles: 500 (0.500 per byte)") != std::string::npos);
+    REQUIRE(report.find("instructions per cycle: 2.000") != std::string::npos);
+    REQUIRE(report.find("cache misses: not supported") != std::string::npos);
+  }
+
+  cleanupTestFile(inputFile);
+  cleanupTestFile(outputFile);
+}
+
+// TEST: xorBytes()
+
+TEST_CASE("In-memory transforms match file processing", "[xor][library]") {
+  const std::string key{"InMemoryLibraryKey"};
+  std::string plain(200003, '\0');
+
+  for (size_t i{0}; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 7 + 3);
+  }
+
+  std::string reference{plain};
+  xorRange(reference, key, 5);
+
+  SECTION("In place, split at any offset") {
+    std::vector<std::byte> data(plain.size());
+    std::memcpy(data.data(), plain.data(), plain.size());
+    std::span<std::byte> bytes{data};
+
+    xorBytes(bytes.first(1000), key, 5);
+    xorBytes(bytes.subspan(1000), key, 1005);
+
+    REQUIRE(std::memcmp(data.data(), reference.data(), data.size()) == 0);
+  }
+
+  SECTION("Source to destination leaves the source untouched") {
+    std::vector<std::byte> source(plain.size());
+    std::vector<std::byte> destination(plain.size());
+    std::memcpy(source.data(), plain.data(), plain.size());
+
+    xorBytes(source, destination, key, 5);
+
+    REQUIRE(std::memcmp(destination.data(), reference.data(),
+                        reference.size()) == 0);
+    REQUIRE(std::memcmp(source.data(), plain.data(), plain.size()) == 0);
+    REQUIRE_THROWS_AS(
+        xorBytes(source, std::span<std::byte>(destination).first(10), key),
+        std::invalid_argument);
+  }
+
+  SECTION("Overlapping buffers behave like a copy, then a transform") {
+    for (ptrdiff_t shift : {-70001, 70001}) {
+      std::vector<std::byte> data(plain.size() + 70001);
+      const size_t from{shift < 0 ? 70001u : 0u};
+      std::memcpy(data.data() + from, plain.data(), plain.size());
+
+      xorBytes(std::span<const std::byte>(data.data() + from, plain.size()),
+               std::span<std::byte>(data.data() + from + shift, plain.size()),
+               key, 5);
+
+      REQUIRE(std::memcmp(data.data() + from + shift, reference.data(),
+                          reference.size()) == 0);
+    }
+  }
+}
+
+// TEST: transformRange() and readRange()
+
+TEST_CASE("Ranges are XORed without processing the whole file",
+          "[xor][range]") {
+  const std::string input{"range_input.bin"};
+  const std::string whole{"range_whole.bin"};
+  const std::string part{"range_part.bin"};
+  const std::string key{"RandomAccessRangeKey"};
+  std::string plain(300007, '\0');
+
+  for (size_t i{0}; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 13 + 1);
+  }
+
+  createTestFile(input, plain);
+
+  SECTION("A range matches the same bytes of a whole-file run") {
+    for (bool legacy : {false, true}) {
+      const ProcessOptions options{.chunkSize = 4096,
+                                   .legacyKeyPhase = legacy};
+      processFileInChunks(input, whole, key, options);
+      const std::string reference{readTestFile(whole)};
+
+      transformRange(input, part, key, 70001, 4096, options);
+      REQUIRE(readTestFile(part) == reference.substr(70001, 4096));
+
+      // Clipped at the end of the file, empty past it
+      transformRange(input, part, key, 299000, UINT64_MAX, options);
+      REQUIRE(readTestFile(part) == reference.substr(299000));
+      transformRange(input, part, key, 400000, 10, options);
+      REQUIRE(readTestFile(part).empty());
+    }
+  }
+
+  SECTION("readRange looks up a record in memory") {
+    std::string reference{plain};
+    xorRange(reference, key, 0);
+    std::vector<std::byte> record(4096);
+
+    REQUIRE(readRange(input, record, key, 123457) == record.size());
+    REQUIRE(std::memcmp(record.data(), reference.data() + 123457,
+                        record.size()) == 0);
+    REQUIRE(readRange(input, record, key, plain.size() - 7) == 7);
+    REQUIRE_THROWS_AS(readRange("range_missing.bin", record, key, 0),
+                      std::runtime_error);
+  }
+
+  SECTION("The input cannot be its own output") {
+    REQUIRE_THROWS_AS(transformRange(input, input, key, 0, 10, {}),
+                      std::runtime_error);
+    REQUIRE(readTestFile(input) == plain);
+  }
+
+  cleanupTestFile(input);
+  cleanupTestFile(whole);
+  cleanupTestFile(part);
+}
+
+// TEST: KeyFile
+
+TEST_CASE("Key files are mapped and may be one-time pads", "[key][keyfile]") {
+  const std::string input{"keyfile_input.bin"};
+  const std::string output{"keyfile_output.bin"};
+  const std::string padPath{"keyfile_pad.bin"};
+  std::string plain(1000003, '\0');
+  std::string pad(plain.size(), '\0');
+
+  for (size_t i{0}; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 11 + 5);
+    pad[i] = static_cast<char>((i * 2654435761u) >> 13);
+  }
+
+  createTestFile(input, plain);
+  createTestFile(padPath, pad);
+
+  SECTION("A pad as long as the data is used byte for byte") {
+    const KeyFile keyFile{padPath};
+    REQUIRE(keyFile.key() == pad);
+
+    for (unsigned threads : {1u, 4u}) {
+      processFileInChunks(input, output, keyFile.key(),
+                          ProcessOptions{.threads = threads});
+      const std::string result{readTestFile(output)};
+      REQUIRE(result.size() == plain.size());
+
+      bool matches{true};
+
+      for (size_t i{0}; i < plain.size(); ++i) {
+        matches = matches && result[i] == static_cast<char>(plain[i] ^ pad[i]);
+      }
+
+      REQUIRE(matches);
+    }
+  }
+
+  SECTION("Short key files are refused") {
+    createTestFile(padPath, "too short");
+    REQUIRE_THROWS_AS(KeyFile{padPath}, std::runtime_error);
+    REQUIRE_THROWS_AS(KeyFile{"keyfile_missing.bin"}, std::runtime_error);
+  }
+
+  cleanupTestFile(input);
+  cleanupTestFile(output);
+  cleanupTestFile(padPath);
+}
+
+// TEST: XorStream
+
+TEST_CASE("XorStream fragments match one contiguous pass", "[xor][stream]") {
+  std::string plain(50000, '\0');
+
+  for (size_t i{0}; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 13 + 1);
+  }
+
+  // Expanded (18), specialized (32) and direct (5000 bytes) key paths
+  for (const std::string& key :
+       {std::string{"EighteenByteKey123"}, std::string(32, 'k'),
+        std::string(5000, 'l')}) {
+    std::string reference{plain};
+    xorRange(reference, key, 0);
+
+    SECTION("Fragments of any size, key length " +
+            std::to_string(key.size())) {
+      XorStream stream{key};
+      std::string data{plain};
+      size_t position{0};
+
+      for (size_t fragment{1}; position < data.size(); fragment += 97) {
+        const size_t len{std::min(fragment, data.size() - position)};
+        stream.apply(std::span<char>(data).subspan(position, len));
+        position += len;
+      }
+
+      REQUIRE(stream.offset() == data.size());
+      REQUIRE(data == reference);
+    }
+
+    SECTION("Clones keep their own offset, key length " +
+            std::to_string(key.size())) {
+      XorStream first{key};
+      std::string head{plain.substr(0, 1000)};
+      first.apply(std::span<char>(head));
+
+      XorStream second{first};
+      std::vector<std::byte> source(plain.size() - 1000);
+      std::vector<std::byte> tail(source.size());
+      std::memcpy(source.data(), plain.data() + 1000, source.size());
+      second.apply(source, tail);
+
+      REQUIRE(first.offset() == 1000);
+      REQUIRE(second.offset() == plain.size());
+      REQUIRE(head == reference.substr(0, 1000));
+      REQUIRE(std::memcmp(tail.data(), reference.data() + 1000,
+                          tail.size()) == 0);
+
+      XorStream moved{std::move(second)};
+      moved.seek(0);
+      std::string again{plain.substr(0, 10)};
+      moved.apply(std::span<char>(again));
+      REQUIRE(again == reference.substr(0, 10));
+    }
+  }
+}
+
+// TEST: XorStreambuf
+
+// Refuses every seek, like a pipe or socket
+struct UnseekableBuffer : std::stringbuf {
+  using std::stringbuf::stringbuf;
+
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+                   std::ios_base::openmode) override {
+    return pos_type(off_type(-1));
+  }
+
+  pos_type seekpos(pos_type, std::ios_base::openmode) override {
+    return pos_type(off_type(-1));
+  }
+};
+
+// Accepts at most `room` more bytes, like a full disk or pipe
+struct LimitedSink : std::stringbuf {
+  std::streamsize room{0};
+
+  std::streamsize xsputn(const char* data, std::streamsize count) override {
+    const std::streamsize len{std::min(count, room)};
+    room -= len;
+    return std::stringbuf::xsputn(data, len);
+  }
+};
+
+TEST_CASE("XorStreambuf XORs iostreams transparently", "[xor][streambuf]") {
+  const std::string streamFile{"test_streambuf.bin"};
+  const std::string key{"StreambufKey12345"};
+  std::string plain(100000, '\0');
+
+  for (size_t i{0}; i < plain.size(); ++i) {
+    plain[i] = static_cast<char>(i * 11 + 5);
+  }
+
+  std::string reference{plain};
+  xorRange(reference, key, 0);
+
+  {
+    // Small and large writes, flushed on destruction
+    std::ofstream file(streamFile, std::ios::binary);
+    XorStreambuf encoded{file.rdbuf(), key, 0, 4096};
+    std::ostream out(&encoded);
+    out.write(plain.data(), 10);
+    out << plain[10];
+    out.write(plain.data() + 11,
+              static_cast<std::streamsize>(plain.size() - 11));
+  }
+
+  SECTION("Written data has the file layout") {
+    REQUIRE(readTestFile(streamFile) == reference);
+  }
+
+  SECTION("Reads, seeks and tells follow the key") {
+    std::ifstream file(streamFile, std::ios::binary);
+    XorStreambuf decoded{file.rdbuf(), key, 0, 4096};
+    std::istream in(&decoded);
+
+    std::string head(5, '\0');
+    in.read(head.data(), 5);
+    REQUIRE(head == plain.substr(0, 5));
+    REQUIRE(in.tellg() == 5);
+
+    // Bypasses the buffer and XORs in place
+    std::string large(20000, '\0');
+    in.read(large.data(), static_cast<std::streamsize>(large.size()));
+    REQUIRE(large == plain.substr(5, large.size()));
+
+    in.seekg(77777);
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[77777]));
+    in.seekg(-1001, std::ios::cur);
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[76777]));
+
+    std::string tail;
+    in.seekg(99990);
+    std::getline(in, tail, '\xff');
+    REQUIRE(plain.substr(99990).find(tail) == 0);
+  }
+
+  SECTION("Seeks before the keyed data are refused") {
+    // A plain header, then data keyed from 0
+    std::stringstream framed{std::string(1000, 'H') + reference};
+    framed.seekg(1000);
+    XorStreambuf decoded{framed.rdbuf(), key};
+    std::istream in(&decoded);
+
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[0]));
+    in.seekg(999);
+    REQUIRE(in.fail());
+
+    // The stream stays where it was
+    in.clear();
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[1]));
+    in.seekg(-10, std::ios::cur);
+    REQUIRE(in.fail());
+    in.clear();
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[2]));
+    in.seekg(1000);
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[0]));
+  }
+
+  SECTION("Refused output is kept for the next flush") {
+    LimitedSink sink;
+    sink.room = 3000;
+    XorStreambuf encoded{&sink, key, 0, 4096};
+    std::ostream out(&encoded);
+
+    out.write(plain.data(), 4000);
+    out.flush();
+    REQUIRE(out.bad());
+    REQUIRE(sink.str() == reference.substr(0, 3000));
+
+    // The retry writes the refused tail once, keyed where it belongs
+    sink.room = 10000;
+    out.clear();
+    out.write(plain.data() + 4000, 2000);
+    out.flush();
+    REQUIRE(out.good());
+    REQUIRE(sink.str() == reference.substr(0, 6000));
+  }
+
+  SECTION("Refused seeks keep the buffered input and the key") {
+    std::stringstream inner{reference};
+    XorStreambuf decoded{inner.rdbuf(), key, 0, 64};
+    std::istream in(&decoded);
+
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[0]));
+    in.seekg(-100, std::ios::cur);
+    REQUIRE(in.fail());
+
+    in.clear();
+    REQUIRE(in.tellg() == 1);
+    REQUIRE(in.get() == static_cast<unsigned char>(plain[1]));
+  }
+
+  SECTION("Writes after reads are refused when inner cannot seek back") {
+    UnseekableBuffer inner{reference};
+    XorStreambuf both{&inner, key, 0, 64};
+    std::iostream io(&both);
+
+    REQUIRE(io.get() == static_cast<unsigned char>(plain[0]));
+    io.put('x');
+    io.flush();
+    REQUIRE(io.bad());
+
+    // The input read ahead is still there
+    io.clear();
+    REQUIRE(io.get() == static_cast<unsigned char>(plain[1]));
+  }
+
+  SECTION("Seeks of both positions at once are refused") {
+    std::stringstream inner{reference};
+    XorStreambuf decoded{inner.rdbuf(), key};
+
+    REQUIRE(decoded.pubseekpos(10) == std::streampos(std::streamoff(-1)));
+    REQUIRE(decoded.pubseekpos(10, std::ios_base::in) == std::streampos(10));
+    REQUIRE(decoded.sgetc() == static_cast<unsigned char>(plain[10]));
+  }
+
+  SECTION("Writes after reads land at the reading position") {
+    std::fstream file(streamFile,
+                      std::ios::binary | std::ios::in | std::ios::out);
+    XorStreambuf both{file.rdbuf(), key, 0, 4096};
+    std::iostream io(&both);
+
+    REQUIRE(io.get() == static_cast<unsigned char>(plain[0]));
+    io.write("patched", 7);
+    io.flush();
+    REQUIRE(io.get() == static_cast<unsigned char>(plain[8]));
+
+    io.seekg(0);
+    std::string start(9, '\0');
+    io.read(start.data(), 9);
+    REQUIRE(start == plain.substr(0, 1) + "patched" + plain.substr(8, 1));
+  }
+
+  cleanupTestFile(streamFile);
+}
+
+// TEST: xorBuffer() / selectXorKernel()
+
+TEST_CASE("XOR kernels match the scalar reference", "[xor][kernel]") {
+  const std::string key{"SecretKey123456789"};
+  std::string data;
+
+  for (int i{0}; i < 1000; ++i) {
+    data += static_cast<char>(i * 7);
+  }
+
+  SECTION("Scalar kernel is always available") {
+    REQUIRE(availableXorKernels().front() == "scalar");
+  }
+
+  SECTION("Unknown kernels are rejected") {
+    REQUIRE_THROWS_AS(selectXorKernel("mmx"), std::runtime_error);
+  }
+
+  SECTION("xorRange keys bytes on their absolute offset") {
+    std::string whole{data};
+    xorRange(std::span<char>(whole), key, 0);
+
+    // Process the same stream as uneven ranges, last range first
+    std::string pieces{data};
+    xorRange(std::span<char>(pieces).subspan(700), key, 700);
+    xorRange(std::span<char>(pieces).subspan(3, 697), key, 3);
+    xorRange(std::span<char>(pieces).first(3), key, 0);
+
+    REQUIRE(pieces == whole);
+  }
+
+  SECTION("Keys of any length repeat exactly across the buffer") {
+    std::string large;
+
+    for (int i{0}; i < 20000; ++i) {
+      large += static_cast<char>(i * 13 + 1);
+    }
+
+    // Lengths around the vector widths, plus keys too long to be expanded
+    for (size_t keyLen : {1, 3, 16, 17, 32, 64, 100, 4095, 5000}) {
+      const std::string longKey{large.substr(7, keyLen)};
+
+      for (size_t keyIndex : {size_t{0}, keyLen / 2, keyLen - 1}) {
+        std::string expected{large};
+
+        for (size_t i{0}; i < expected.size(); ++i) {
+          expected[i] ^= longKey[(keyIndex + i) % keyLen];
+        }
+
+        std::string actual{large};
+        xorBuffer(&actual[0], actual.size(), longKey, keyIndex);
+        REQUIRE(actual == expected);
+      }
+    }
+  }
+
+  SECTION("Every supported kernel produces identical output") {
+    // 16, 32 and 64 byte keys take the specialized kernels
+    for (const std::string& kernelKey :
+         {key, data.substr(1, 16), data.substr(2, 32), data.substr(3, 64)}) {
+      for (size_t keyIndex : {0, 5, 17}) {
+        selectXorKernel("scalar");
+        std::string expected{data};
+        xorBuffer(&expected[0], expected.size(), kernelKey, keyIndex);
+
+        for (const std::string& name : availableXorKernels()) {
+          selectXorKernel(name);
+          REQUIRE(xorKernelName() == name);
+
+          // Odd lengths exercise the scalar tail of the vector kernels
+          for (size_t len :
+               {size_t{0}, size_t{15}, size_t{64}, size_t{100}, data.size()}) {
+            std::string actual{data.substr(0, len)};
+            xorBuffer(&actual[0], actual.size(), kernelKey, keyIndex);
+            REQUIRE(actual == expected.substr(0, len));
+          }
+        }
+      }
+    }
+
+    selectXorKernel("auto");
+  }
+}